@@ -0,0 +1,515 @@
+/* Benchmark and golden-image check of the drawing primitives, see gfx.h
+ *
+ * Every case draws a fixed corpus into a framebuffer. The result must match
+ * bench/golden/<case>.pbm byte for byte.
+ *
+ * Host usage: gfx_bench [-g golden dir] [-t ms per case] [-u] [-a]
+ *   -u  rewrites the golden images from the current primitives
+ *   -a  checks an AVR report (see below) read from stdin instead
+ * Exits with 1 on any mismatch.
+ *
+ * Built for the AVR, it prints "gfx case ops reps cycles crc" per case on the
+ * UART and sleeps with interrupts off, which stops simavr. Cycles come from
+ * Timer1, so under the simulator they are exact up to the 8 cycle tick.
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <avr/pgmspace.h>
+
+#include "../gfx.h"
+#include "../frame.h"
+#include "../img.h"
+#include "../wire3d.h"
+#include "../spectrum.h"
+
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+
+static uint8_t screen[GFX_SIZE], *b = screen;
+
+/* Endpoints at 90 pixels from the centre every 7.5 degrees, all clipped */
+static const int8_t fan[][2] PROGMEM = {
+	{ 90, 0 }, { 89, 12 }, { 87, 23 }, { 83, 34 }, { 78, 45 }, { 71, 55 },
+	{ 64, 64 }, { 55, 71 }, { 45, 78 }, { 34, 83 }, { 23, 87 }, { 12, 89 },
+	{ 0, 90 }, { -12, 89 }, { -23, 87 }, { -34, 83 }, { -45, 78 },
+	{ -55, 71 }, { -64, 64 }, { -71, 55 }, { -78, 45 }, { -83, 34 },
+	{ -87, 23 }, { -89, 12 }, { -90, 0 }, { -89, -12 }, { -87, -23 },
+	{ -83, -34 }, { -78, -45 }, { -71, -55 }, { -64, -64 }, { -55, -71 },
+	{ -45, -78 }, { -34, -83 }, { -23, -87 }, { -12, -89 }, { 0, -90 },
+	{ 12, -89 }, { 23, -87 }, { 34, -83 }, { 45, -78 }, { 55, -71 },
+	{ 64, -64 }, { 71, -55 }, { 78, -45 }, { 83, -34 }, { 87, -23 },
+	{ 89, -12 },
+};
+
+/* Horizon offsets of the main loop, -lround(64*tan(phi)) for phi
+ * from -80 to 80 degrees in 4 degree steps */
+static const int16_t horizon[] PROGMEM = {
+	363, 257, 197, 158, 131, 111, 95, 82, 71, 62, 54, 46, 40, 34, 28, 23,
+	18, 14, 9, 4, 0, -4, -9, -14, -18, -23, -28, -34, -40, -46, -54, -62,
+	-71, -82, -95, -111, -131, -158, -197, -257, -363,
+};
+
+static uint16_t run_clear(void)
+{
+	gfx_clear(b);
+	return 1;
+}
+
+static uint16_t run_blit(void)
+{
+	gfx_blit_P(b, header_data);
+	return 1;
+}
+
+static uint16_t run_pixel_set(void)
+{
+	uint8_t x, y;
+
+	for (y = 0; y < GFX_HEIGHT; y++)
+		for (x = y & 1; x < GFX_WIDTH; x += 2)
+			putpixel(b, x, y, true);
+	return GFX_WIDTH * GFX_HEIGHT / 2;
+}
+
+/* Starts from a lit screen */
+static uint16_t run_pixel_clear(void)
+{
+	uint8_t x, y;
+
+	for (y = 0; y < GFX_HEIGHT; y++)
+		for (x = y % 3; x < GFX_WIDTH; x += 3)
+			putpixel(b, x, y, false);
+	return (GFX_WIDTH * GFX_HEIGHT + 2) / 3;
+}
+
+static uint16_t run_line_hv(void)
+{
+	uint8_t i;
+
+	for (i = 0; i < GFX_WIDTH; i += 8)
+		line(b, i, 0, i, GFX_HEIGHT - 1);
+	for (i = 0; i < GFX_HEIGHT; i += 8)
+		line(b, 0, i, GFX_WIDTH - 1, i);
+	return GFX_WIDTH / 8 + GFX_HEIGHT / 8;
+}
+
+static uint16_t run_line_fan(void)
+{
+	uint8_t i;
+
+	for (i = 0; i < ARRAY_SIZE(fan); i++)
+		line(b, 64, 32, 64 + (int8_t)pgm_read_byte(&fan[i][0]),
+				32 + (int8_t)pgm_read_byte(&fan[i][1]));
+	return ARRAY_SIZE(fan);
+}
+
+static uint16_t run_line_horizon(void)
+{
+	uint8_t i;
+
+	for (i = 0; i < ARRAY_SIZE(horizon); i++) {
+		const int16_t dy = pgm_read_word(&horizon[i]);
+
+		line(b, 0, 32 + dy, 127, 32 - dy);
+	}
+	return ARRAY_SIZE(horizon);
+}
+
+/* Short strokes all over the screen, as text or small glyphs would draw */
+static uint16_t run_line_short(void)
+{
+	uint16_t seed = 1;
+	uint16_t i;
+
+	for (i = 0; i < 256; i++) {
+		uint8_t x, y;
+
+		seed = seed * 25173 + 13849;
+		x = (seed >> 8) & 0x7f;
+		y = seed & 0x3f;
+		line(b, x, y, x + (seed >> 13) - 3, y + ((seed >> 10) & 7) - 3);
+	}
+	return 256;
+}
+
+/* Roll, pitch and heading in degrees, a model per pose, as the display
+ * would render them */
+static const int16_t poses[][3] PROGMEM = {
+	{ 0, 0, 0 }, { 30, 0, 0 }, { 0, 30, 0 }, { 0, 0, 30 },
+	{ -45, 20, 60 }, { 90, -45, 135 }, { 170, 10, -100 }, { 15, 80, 200 },
+};
+
+static uint16_t run_wire3d(void)
+{
+	uint16_t edges = 0;
+	uint8_t i;
+
+	for (i = 0; i < ARRAY_SIZE(poses); i++) {
+		const struct wire3d_model *m = i & 1? &wire3d_aircraft:
+			&wire3d_cube;
+		struct fix_mat3 r;
+
+		fix_rotation(&r, DEG_TO_ANGLE((int16_t)pgm_read_word(&poses[i][0])),
+				DEG_TO_ANGLE((int16_t)pgm_read_word(&poses[i][1])),
+				DEG_TO_ANGLE((int16_t)pgm_read_word(&poses[i][2])));
+		wire3d_draw(b, m, &r);
+		edges += pgm_read_byte(&m->n_edges);
+	}
+	return edges;
+}
+
+/* Blocks of 1 g on z shaken at 125 and 350 Hz by 100 and 20 LSB,
+ * sampled at 1600 Hz: bins 5 and 14 */
+#define SPECTRUM_BLOCKS 4
+
+static uint16_t run_spectrum(void)
+{
+	uint16_t n;
+
+	spectrum_set_rate(1600);
+	for (n = 0; n < SPECTRUM_BLOCKS * FFT_SIZE; n++)
+		if (spectrum_push(256 + q15_mul(100, fix_sin(n * 5120U)) +
+				q15_mul(20, fix_sin(n * 14336U))))
+			spectrum_analyse();
+	spectrum_draw(b);
+	return SPECTRUM_BLOCKS;
+}
+
+/* A case drawn a page at a time into a band buffer, as the main loop
+ * does, must come out as drawn on the whole screen */
+static uint16_t in_bands(uint16_t (*run)(void))
+{
+	static uint8_t band[GFX_WIDTH];
+	uint16_t ops = 0;
+	uint8_t page;
+
+	for (page = 0; page < GFX_HEIGHT / 8; page++) {
+		memcpy(band, &screen[page * GFX_WIDTH], GFX_WIDTH);
+		b = band;
+		gfx_set_band(page, 1);
+		ops = run();
+		b = screen;
+		memcpy(&screen[page * GFX_WIDTH], band, GFX_WIDTH);
+	}
+	gfx_set_band(0, GFX_HEIGHT / 8);
+	return ops;
+}
+
+static uint16_t run_horizon_bands(void)
+{
+	return in_bands(run_line_horizon);
+}
+
+static uint16_t run_wire3d_bands(void)
+{
+	return in_bands(run_wire3d);
+}
+
+static uint16_t run_spectrum_bands(void)
+{
+	return in_bands(run_spectrum);
+}
+
+struct bench_case {
+	const char *name;
+	uint8_t fill;
+	uint16_t (*run)(void);
+};
+
+static const struct bench_case cases[] = {
+	{ "clear",       0xff, run_clear },
+	{ "blit",        0x00, run_blit },
+	{ "pixel_set",   0x00, run_pixel_set },
+	{ "pixel_clear", 0xff, run_pixel_clear },
+	{ "line_hv",     0x00, run_line_hv },
+	{ "line_fan",    0x00, run_line_fan },
+	{ "line_horizon", 0x00, run_line_horizon },
+	{ "line_short",  0x00, run_line_short },
+	{ "wire3d",      0x00, run_wire3d },
+	{ "spectrum",    0x00, run_spectrum },
+	{ "horizon_bands", 0x00, run_horizon_bands },
+	{ "wire3d_bands", 0x00, run_wire3d_bands },
+	{ "spectrum_bands", 0x00, run_spectrum_bands },
+};
+
+static uint16_t fb_crc16(const uint8_t *fb)
+{
+	uint16_t crc = 0xffff;
+	uint16_t i;
+
+	for (i = 0; i < GFX_SIZE; i += 128)
+		crc = frame_crc16(crc, fb + i, 128);
+	return crc;
+}
+
+#ifdef __AVR__
+
+#include <avr/interrupt.h>
+#include <avr/sleep.h>
+
+#include "../uart.h"
+#include "../clock.h"
+
+#ifndef UART_BAUDRATE
+#define UART_BAUDRATE 115200
+#endif
+
+#define BENCH_REPS 4
+#define CYCLES_PER_TICK (F_CPU / 1000000UL / CLOCK_TICKS_PER_US)
+
+int main(void)
+{
+	uint8_t i, rep;
+
+	init_uart(UART_BAUDRATE);
+	init_clock();
+	sei();
+
+	for (i = 0; i < ARRAY_SIZE(cases); i++) {
+		uint32_t ticks = 0;
+		uint16_t ops = 0;
+
+		for (rep = 0; rep < BENCH_REPS; rep++) {
+			uint32_t t0;
+
+			memset(screen, cases[i].fill, sizeof(screen));
+			t0 = clock_ticks();
+			ops = cases[i].run();
+			ticks += clock_ticks() - t0;
+		}
+		printf("gfx %s %u %u %lu %04x\r\n", cases[i].name, ops, BENCH_REPS,
+				ticks * CYCLES_PER_TICK, fb_crc16(screen));
+	}
+
+	while (uart_tx_free() < 128);
+	cli();
+	sleep_enable();
+	sleep_cpu();
+
+	return 0;
+}
+
+#else
+
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+static const char *golden_dir = "bench/golden";
+
+static uint64_t now_ns(void)
+{
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+
+/* Cost of a now_ns() pair, taken off every timed run */
+static uint64_t timer_overhead(void)
+{
+	uint64_t best = UINT64_MAX;
+	int i;
+
+	for (i = 0; i < 1000; i++) {
+		const uint64_t t0 = now_ns();
+		const uint64_t t = now_ns() - t0;
+
+		if (t < best)
+			best = t;
+	}
+	return best;
+}
+
+static void golden_path(char *path, const size_t n, const char *name)
+{
+	snprintf(path, n, "%s/%s.pbm", golden_dir, name);
+}
+
+/* Lit pixels come out black, as in the simulator dumps */
+static int write_pbm(const char *path, const uint8_t *fb)
+{
+	FILE *f = fopen(path, "wb");
+	int x, y;
+
+	if (!f) {
+		perror(path);
+		return -1;
+	}
+	fprintf(f, "P4\n%d %d\n", GFX_WIDTH, GFX_HEIGHT);
+	for (y = 0; y < GFX_HEIGHT; y++)
+		for (x = 0; x < GFX_WIDTH; x += 8) {
+			uint8_t c = 0;
+			int i;
+
+			for (i = 0; i < 8; i++)
+				if (fb[((y & ~7) << 4) + x + i] & (1 << (y & 7)))
+					c |= 0x80 >> i;
+			fputc(c, f);
+		}
+	return fclose(f);
+}
+
+static int read_pbm(const char *path, uint8_t *fb)
+{
+	FILE *f = fopen(path, "rb");
+	int w, h, x, y;
+
+	if (!f)
+		return -1;
+	if (fscanf(f, "P4 %d %d", &w, &h) != 2 || w != GFX_WIDTH ||
+			h != GFX_HEIGHT || fgetc(f) == EOF) {
+		fclose(f);
+		return -1;
+	}
+	memset(fb, 0, GFX_SIZE);
+	for (y = 0; y < GFX_HEIGHT; y++)
+		for (x = 0; x < GFX_WIDTH; x += 8) {
+			const int c = fgetc(f);
+			int i;
+
+			if (c == EOF) {
+				fclose(f);
+				return -1;
+			}
+			for (i = 0; i < 8; i++)
+				if (c & (0x80 >> i))
+					fb[((y & ~7) << 4) + x + i] |= 1 << (y & 7);
+		}
+	fclose(f);
+	return 0;
+}
+
+/* @return number of differing bytes, -1 without a golden image */
+static int check_golden(const char *name, const uint8_t *fb)
+{
+	uint8_t golden[GFX_SIZE];
+	char path[256];
+	int i, diff = 0;
+
+	golden_path(path, sizeof(path), name);
+	if (read_pbm(path, golden))
+		return -1;
+	for (i = 0; i < GFX_SIZE; i++)
+		diff += fb[i] != golden[i];
+	return diff;
+}
+
+static const char *verdict(const int diff)
+{
+	static char s[32];
+
+	if (diff < 0)
+		return "no golden";
+	if (!diff)
+		return "ok";
+	snprintf(s, sizeof(s), "FAIL %d bytes", diff);
+	return s;
+}
+
+static int bench_host(const unsigned ms, const bool update)
+{
+	const uint64_t overhead = timer_overhead();
+	unsigned i;
+	int failed = 0;
+
+	printf("%-13s %5s %7s %10s  %s\n", "case", "ops", "reps", "ns/op",
+			"golden");
+	for (i = 0; i < ARRAY_SIZE(cases); i++) {
+		const uint64_t budget = ms * 1000000ULL;
+		uint64_t ns = 0;
+		unsigned long reps = 0;
+		uint16_t ops = 0;
+		char path[256];
+		int diff;
+
+		do {
+			uint64_t t0;
+
+			memset(screen, cases[i].fill, sizeof(screen));
+			t0 = now_ns();
+			ops = cases[i].run();
+			ns += now_ns() - t0 - overhead;
+			reps++;
+		} while (ns < budget);
+
+		if (update) {
+			golden_path(path, sizeof(path), cases[i].name);
+			if (write_pbm(path, screen))
+				return 1;
+		}
+		diff = check_golden(cases[i].name, screen);
+		failed |= diff != 0;
+		printf("%-13s %5u %7lu %10.2f  %s\n", cases[i].name, ops, reps,
+				(double)ns / reps / ops, verdict(diff));
+	}
+
+	return failed;
+}
+
+/* Compares the CRCs of an AVR run with the golden images */
+static int check_avr(FILE *in)
+{
+	char s[128];
+	int failed = 0, seen = 0;
+
+	printf("%-13s %5s %5s %10s  %s\n", "case", "ops", "reps", "cycles/op",
+			"golden");
+	while (fgets(s, sizeof(s), in)) {
+		char name[32];
+		unsigned ops, reps, crc;
+		unsigned long cycles;
+		uint8_t golden[GFX_SIZE];
+		char path[256];
+		const char *result = "no golden";
+		/* Simulators may prefix the UART lines */
+		const char *p = strstr(s, "gfx ");
+
+		if (!p || sscanf(p + 4, "%31s %u %u %lu %x", name, &ops, &reps, &cycles,
+					&crc) != 5 || !ops || !reps)
+			continue;
+		golden_path(path, sizeof(path), name);
+		if (!read_pbm(path, golden))
+			result = fb_crc16(golden) == crc? "ok": "FAIL crc";
+		failed |= strcmp(result, "ok") != 0;
+		seen++;
+		printf("%-13s %5u %5u %10.1f  %s\n", name, ops, reps,
+				(double)cycles / reps / ops, result);
+	}
+
+	return failed || seen != ARRAY_SIZE(cases);
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned ms = 50;
+	bool update = false, avr = false;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "g:t:ua")) != -1) {
+		switch (opt) {
+			case 'g':
+				golden_dir = optarg;
+				break;
+			case 't':
+				ms = atoi(optarg);
+				break;
+			case 'u':
+				update = true;
+				break;
+			case 'a':
+				avr = true;
+				break;
+			default:
+				fprintf(stderr, "Usage: %s [-g golden dir] [-t ms] [-u] [-a]\n",
+						argv[0]);
+				return 2;
+		}
+	}
+
+	return avr? check_avr(stdin): bench_host(ms, update);
+}
+
+#endif
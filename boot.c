@@ -0,0 +1,55 @@
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <avr/pgmspace.h>
+
+#include "boot.h"
+#include "clock.h"
+#include "uart.h"
+
+void boot_run(const struct boot_device *devices, const uint8_t n)
+{
+	const uint32_t start = clock_us();
+	struct {
+		uint8_t step, chunks;
+		uint32_t ready;    /* us, the next step may run from then on */
+	} state[BOOT_MAX_DEVICES];
+	struct boot_device d;
+	struct boot_step s;
+	uint8_t i, left = n;
+
+	for (i = 0; i < n; i++) {
+		state[i].step = state[i].chunks = 0;
+		state[i].ready = start;
+	}
+
+	while (left) {
+		for (i = 0; i < n; i++) {
+			const uint32_t now = clock_us();
+
+			memcpy_P(&d, &devices[i], sizeof(d));
+			if (state[i].step == d.n_steps ||
+					(int32_t)(now - state[i].ready) < 0)
+				continue;
+
+			memcpy_P(&s, &d.steps[state[i].step], sizeof(s));
+			state[i].chunks++;
+			if (!s.run())
+				continue;
+			state[i].ready = clock_us() + s.settle_us;
+			if (++state[i].step == d.n_steps)
+				left--;
+		}
+	}
+	/* The last devices may still be settling */
+	for (i = 0; i < n; i++)
+		while ((int32_t)(clock_us() - state[i].ready) < 0);
+
+	printb("boot:");
+	for (i = 0; i < n; i++) {
+		memcpy_P(&d, &devices[i], sizeof(d));
+		printb(" %s %" PRIu32 " us in %u steps,", d.name, state[i].ready - start,
+				state[i].chunks);
+	}
+	printb(" total %" PRIu32 " us\r\n", clock_us() - start);
+}
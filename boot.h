@@ -0,0 +1,35 @@
+#ifndef _BOOT_H
+#define _BOOT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/** Init sequencer.
+ *
+ *  Every device comes up as a list of steps, each followed by the time
+ *  it needs to settle before the next step of the same device may run.
+ *  boot_run() goes round the devices and runs one step of whichever is
+ *  ready, so a device settling or a long transfer split into chunks
+ *  doesn't hold up the others. Step and device tables live in PROGMEM.
+ */
+
+#define BOOT_MAX_DEVICES 4
+
+struct boot_step {
+	/** @return true once done, false to be called again for the next
+	 *  chunk */
+	bool (*run)(void);
+	uint16_t settle_us;
+};
+
+struct boot_device {
+	char name[8];
+	const struct boot_step *steps;
+	uint8_t n_steps;
+};
+
+/** Brings all devices up and prints when each one was ready
+ *  @param n up to BOOT_MAX_DEVICES */
+void boot_run(const struct boot_device *devices, const uint8_t n);
+
+#endif /* _BOOT_H */
@@ -0,0 +1,48 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+#include <avr/eeprom.h>
+
+#include "calib.h"
+#include "frame.h"
+
+struct calib calib;
+
+static uint16_t calib_crc(const struct calib *c)
+{
+	return frame_crc16(0xffff, (const uint8_t *)c,
+			offsetof(struct calib, crc));
+}
+
+void calib_reset(void)
+{
+	uint8_t i;
+
+	memset(&calib, 0, sizeof(calib));
+	calib.version = CALIB_VERSION;
+	for (i = 0; i < 3; i++)
+		calib.mag_scale[i] = CALIB_SCALE_ONE;
+}
+
+bool calib_load(void)
+{
+	struct calib c;
+
+	eeprom_read_block(&c, (const void *)CALIB_EEPROM_ADDR, sizeof(c));
+	if (c.version != CALIB_VERSION || c.crc != calib_crc(&c)) {
+		calib_reset();
+		return false;
+	}
+
+	calib = c;
+	return true;
+}
+
+void calib_save(void)
+{
+	calib.version = CALIB_VERSION;
+	calib.crc = calib_crc(&calib);
+	eeprom_update_block(&calib, (void *)CALIB_EEPROM_ADDR, sizeof(calib));
+}
@@ -0,0 +1,43 @@
+#ifndef _CALIB_H
+#define _CALIB_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/** Sensor calibration kept in the EEPROM.
+ *
+ *  One versioned record at the start of the EEPROM, protected by the
+ *  CRC-16 of frame.h. An erased or stale record fails to load and the
+ *  drivers run uncalibrated. The accelerometer offsets go into the
+ *  ADXL345 OFSx registers, so they cost nothing per sample.
+ */
+
+#define CALIB_VERSION 1
+#define CALIB_EEPROM_ADDR 0
+
+/* Soft-iron scale of 1.0 */
+#define CALIB_SCALE_ONE 4096
+
+struct calib {
+	uint8_t version;
+	int8_t acc_offset[3];   /* ADXL345 OFSx, 15.6 mg/LSB */
+	int16_t gyro_bias[3];   /* raw LSB */
+	int16_t mag_offset[3];  /* hard iron, raw LSB, x, y, z */
+	int16_t mag_scale[3];   /* soft iron, CALIB_SCALE_ONE is 1.0 */
+	uint16_t crc;
+};
+
+extern struct calib calib;
+
+/** Reads the record, a bad one leaves a neutral calibration behind
+ *  @return true if a valid record was found
+ */
+bool calib_load(void);
+
+/** Writes back the bytes that changed */
+void calib_save(void);
+
+/** Resets to a neutral calibration, the EEPROM is left alone */
+void calib_reset(void);
+
+#endif /* _CALIB_H */
@@ -0,0 +1,61 @@
+#include <stdint.h>
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+
+#include "clock.h"
+
+#define BIT(n) (1 << (n))
+
+_Static_assert(CLOCK_TICKS_PER_US && !(0x10000 % CLOCK_TICKS_PER_US),
+		"a Timer1 period must be whole microseconds");
+
+/* 32 bits, so the microseconds keep their top bits */
+static volatile uint32_t clock_overflows = 0;
+
+void init_clock(void)
+{
+	TCCR1A = 0;
+	TCCR1B = BIT(CS11); /* normal mode, clk/8 */
+	TCNT1 = 0;
+	TIFR1 = BIT(TOV1);
+	TIMSK1 = BIT(TOIE1);
+}
+
+/* Timer1 overflows and count, read together */
+static uint16_t clock_read(uint32_t *hi)
+{
+	uint16_t lo;
+
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		*hi = clock_overflows;
+		lo = TCNT1;
+		/* Overflow which happened after interrupts were disabled */
+		if ((TIFR1 & BIT(TOV1)) && lo < 0x8000)
+			(*hi)++;
+	}
+
+	return lo;
+}
+
+uint32_t clock_ticks(void)
+{
+	uint32_t hi;
+	const uint16_t lo = clock_read(&hi);
+
+	return hi << 16 | lo;
+}
+
+uint32_t clock_us(void)
+{
+	uint32_t hi;
+	const uint16_t lo = clock_read(&hi);
+
+	return hi * (0x10000 / CLOCK_TICKS_PER_US) + lo / CLOCK_TICKS_PER_US;
+}
+
+ISR(TIMER1_OVF_vect)
+{
+	clock_overflows++;
+}
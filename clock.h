@@ -0,0 +1,34 @@
+#ifndef _CLOCK_H
+#define _CLOCK_H
+
+#include <stdint.h>
+
+#include <avr/io.h>
+#include <util/atomic.h>
+
+/* Timer1 runs free with a /8 prescaler */
+#define CLOCK_TICKS_PER_US (F_CPU / 8 / 1000000UL)
+
+/** Timebase initialization, takes over Timer1 */
+void init_clock(void);
+
+/** @return 32-bit timestamp in timer ticks, wraps after ~35 minutes */
+uint32_t clock_ticks(void);
+
+/** @return 32-bit timestamp in microseconds, wraps after ~71 minutes, at
+ *  2^32 like any uint32_t difference expects */
+uint32_t clock_us(void);
+
+/** @return low 16 bits of the timestamp, cheap enough for hot paths.
+ *  The two byte reads share the TEMP register with every other 16-bit
+ *  Timer1 access, e.g. clock_us() in the sampler ISR, hence atomic. */
+static inline uint16_t clock_ticks16(void)
+{
+	uint16_t t;
+
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+		t = TCNT1;
+	return t;
+}
+
+#endif /* _CLOCK_H */
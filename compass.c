@@ -0,0 +1,140 @@
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "compass.h"
+#include "sensor.h"
+#include "uart.h"
+
+enum {
+	COMPASS_CRA     = 0x00,
+	COMPASS_CRB     = 0x01,
+	COMPASS_MODE    = 0x02
+};
+
+enum {
+	COMPASS_CRA_SELF_TEST = 0x71, /* 8 averaged, 15 Hz, positive bias */
+	COMPASS_CRB_GAIN_390  = 0xa0, /* +-4.7 G */
+	COMPASS_SINGLE        = 0x01
+};
+
+/* Self-test limits at 390 LSB/G */
+#define COMPASS_TEST_MIN 243
+#define COMPASS_TEST_MAX 575
+
+#define COMPASS_PERIOD_US (1000000UL / COMPASS_ODR)
+
+/* Soft iron scale of 1.0, as in calib.h, and the narrowest field swing
+ * accepted for calibration, ~0.15 G */
+#define COMPASS_SCALE_SHIFT 12
+#define COMPASS_SCALE_ONE (1 << COMPASS_SCALE_SHIFT)
+#define COMPASS_CAL_MIN_RADIUS 60
+
+static int16_t cal_offset[3];
+static int16_t cal_scale[3] = {
+	COMPASS_SCALE_ONE, COMPASS_SCALE_ONE, COMPASS_SCALE_ONE
+};
+static bool calibrating;
+static int16_t cal_min[3], cal_max[3];
+
+static void compass_write(const uint8_t reg, const uint8_t value)
+{
+	sensor_write(SENSOR_ID_COMPASS, reg, 1, &value);
+}
+
+/* The first continuous sample is ready a period later */
+void init_compass(void)
+{
+	sensor_init(SENSOR_ID_COMPASS);
+	sensor_defer(SENSOR_ID_COMPASS, COMPASS_PERIOD_US);
+}
+
+void compass_test_start(void)
+{
+	compass_write(COMPASS_CRB, COMPASS_CRB_GAIN_390);
+	compass_write(COMPASS_CRA, COMPASS_CRA_SELF_TEST);
+	compass_write(COMPASS_MODE, COMPASS_SINGLE);
+}
+
+bool compass_test_check(void)
+{
+	int16_t v[1][3];
+	uint8_t i;
+	bool ok = sensor_read(SENSOR_ID_COMPASS, v, 1);
+
+	for (i = 0; i < 3; i++)
+		if (v[0][i] < COMPASS_TEST_MIN || v[0][i] > COMPASS_TEST_MAX)
+			ok = false;
+	if (ok)
+		printb("Compass self-test ok\r\n");
+	else
+		printb("Compass self-test error: %+hd/%+hd/%+hd\r\n",
+				v[0][0], v[0][1], v[0][2]);
+
+	return ok;
+}
+
+void compass_set_calibration(const int16_t offset[3], const int16_t scale[3])
+{
+	uint8_t i;
+
+	for (i = 0; i < 3; i++) {
+		cal_offset[i] = offset[i];
+		cal_scale[i] = scale[i];
+	}
+}
+
+void compass_calibrate(void)
+{
+	uint8_t i;
+
+	for (i = 0; i < 3; i++) {
+		cal_min[i] = INT16_MAX;
+		cal_max[i] = INT16_MIN;
+	}
+	calibrating = true;
+}
+
+bool compass_calibrate_done(int16_t offset[3], int16_t scale[3])
+{
+	int16_t radius[3];
+	int32_t mean = 0;
+	uint8_t i;
+
+	calibrating = false;
+	for (i = 0; i < 3; i++) {
+		radius[i] = ((int32_t)cal_max[i] - cal_min[i]) / 2;
+		if (radius[i] < COMPASS_CAL_MIN_RADIUS)
+			return false;
+		mean += radius[i];
+	}
+	mean /= 3;
+	/* A scale of 8 or more doesn't fit, nor would such a lopsided swing
+	 * make a calibration */
+	for (i = 0; i < 3; i++)
+		if (mean * COMPASS_SCALE_ONE / radius[i] > INT16_MAX)
+			return false;
+	for (i = 0; i < 3; i++) {
+		offset[i] = ((int32_t)cal_max[i] + cal_min[i]) / 2;
+		scale[i] = mean * COMPASS_SCALE_ONE / radius[i];
+	}
+	compass_set_calibration(offset, scale);
+
+	return true;
+}
+
+void compass_correct(int16_t m[3])
+{
+	uint8_t i;
+
+	/* Tracks the raw extremes while calibrating */
+	for (i = 0; i < 3; i++) {
+		if (calibrating) {
+			if (m[i] < cal_min[i])
+				cal_min[i] = m[i];
+			if (m[i] > cal_max[i])
+				cal_max[i] = m[i];
+		}
+		m[i] = (((int32_t)m[i] - cal_offset[i]) * cal_scale[i]) >>
+			COMPASS_SCALE_SHIFT;
+	}
+}
@@ -0,0 +1,49 @@
+#ifndef _COMPASS_H
+#define _COMPASS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/** HMC5883L magnetometer driver.
+ *
+ *  The chip measures continuously at 75 Hz and sensor_poll() reads it (see
+ *  sensor.h). Reads are paced by the host clock rather than the RDY bit,
+ *  which would cost another transaction per poll, so a drifting chip clock
+ *  can now and then skip or repeat one.
+ */
+
+#define COMPASS_ODR 75
+
+/** Starts measuring, after the self-test if there is one */
+void init_compass(void);
+
+/** Self-test: compass_test_start() switches on the positive bias for a
+ *  single measurement, compass_test_check() reads it COMPASS_TEST_US
+ *  later and prints the result. init_compass() then restores the
+ *  configuration.
+ *  @return whether all axes are within the limits
+ */
+#define COMPASS_TEST_US 10000
+void compass_test_start(void);
+bool compass_test_check(void);
+
+/** Hard and soft iron correction, applied as (m - offset) * scale / 4096 */
+void compass_set_calibration(const int16_t offset[3], const int16_t scale[3]);
+
+/** Starts tracking the field extremes, the board has to be turned around
+ *  every axis until compass_calibrate_done() */
+void compass_calibrate(void);
+
+/** Centres the extremes and scales every axis to their mean radius, then
+ *  applies the result
+ *  @return false if an axis has not been turned enough, or much less
+ *  than the others
+ */
+bool compass_calibrate_done(int16_t offset[3], int16_t scale[3]);
+
+/** Applies the calibration to a sample
+ *  @param m field as x, y, z, 390 LSB per gauss
+ */
+void compass_correct(int16_t m[3]);
+
+#endif /* _COMPASS_H */
@@ -0,0 +1,106 @@
+#include <stdint.h>
+
+#include "fft.h"
+
+#define FFT_HALF (FFT_SIZE / 2)
+
+_Static_assert(FFT_LOG2 >= 2 && FFT_LOG2 <= 7,
+		"FFT_SIZE must be a power of two from 4 up to 128");
+
+static void bit_reverse(q15_t z[FFT_HALF][2])
+{
+	uint8_t i, j = 0, bit;
+
+	for (i = 1; i < FFT_HALF; i++) {
+		for (bit = FFT_HALF >> 1; j & bit; bit >>= 1)
+			j ^= bit;
+		j |= bit;
+		if (i < j) {
+			const q15_t r = z[i][0], m = z[i][1];
+
+			z[i][0] = z[j][0];
+			z[i][1] = z[j][1];
+			z[j][0] = r;
+			z[j][1] = m;
+		}
+	}
+}
+
+/* Complex transform of FFT_HALF points. The twiddles are multiples of a
+ * 1/FFT_HALF turn, whole steps of the sine table. The halved outputs of a
+ * butterfly are no larger than its inputs. */
+static void fft_complex(q15_t z[FFT_HALF][2])
+{
+	uint8_t half, k, i;
+
+	bit_reverse(z);
+	for (half = 1; half < FFT_HALF; half <<= 1) {
+		/* W = exp(-j 2 pi k / 2 half) */
+		const uint16_t step = 0x8000 / half;
+
+		for (k = 0; k < half; k++) {
+			const q15_t wr = fix_cos(k * step), wi = -fix_sin(k * step);
+
+			for (i = k; i < FFT_HALF; i += 2 * half) {
+				const uint8_t j = i + half;
+				const int32_t tr = ((int32_t)wr * z[j][0] -
+						(int32_t)wi * z[j][1]) >> 15;
+				const int32_t ti = ((int32_t)wr * z[j][1] +
+						(int32_t)wi * z[j][0]) >> 15;
+
+				z[j][0] = (z[i][0] - tr) >> 1;
+				z[j][1] = (z[i][1] - ti) >> 1;
+				z[i][0] = (z[i][0] + tr) >> 1;
+				z[i][1] = (z[i][1] + ti) >> 1;
+			}
+		}
+	}
+}
+
+/* Z is the transform of the even samples as real parts and the odd ones as
+ * imaginary parts. With A = Z[k] + Z*[m] and B = -j (Z[k] - Z*[m]) for
+ * m = FFT_HALF - k, bin k is (A + W^k B) / 4 and bin m (A - W^k B)* / 4,
+ * W = exp(-j 2 pi / FFT_SIZE). A and B are halved first, so that W^k B
+ * fits 32 bits. */
+void fft_real_q15(q15_t x[FFT_SIZE])
+{
+	q15_t (*z)[2] = (q15_t (*)[2])x;
+	uint8_t k;
+
+	fft_complex(z);
+	{
+		const int32_t a = z[0][0], b = z[0][1];
+
+		x[0] = (a + b) >> 1;
+		x[1] = (a - b) >> 1;
+	}
+	for (k = 1; k <= FFT_HALF / 2; k++) {
+		const uint8_t m = FFT_HALF - k;
+		const uint16_t angle = (uint16_t)k << (16 - FFT_LOG2);
+		const int32_t c = fix_cos(angle), s = fix_sin(angle);
+		const int32_t ar = ((int32_t)z[k][0] + z[m][0]) >> 1;
+		const int32_t ai = ((int32_t)z[k][1] - z[m][1]) >> 1;
+		const int32_t br = ((int32_t)z[k][1] + z[m][1]) >> 1;
+		const int32_t bi = ((int32_t)z[m][0] - z[k][0]) >> 1;
+		/* W^k = c - j s */
+		const int32_t wr = (c * br + s * bi) >> 15;
+		const int32_t wi = (c * bi - s * br) >> 15;
+
+		z[k][0] = (ar + wr) >> 1;
+		z[k][1] = (ai + wi) >> 1;
+		z[m][0] = (ar - wr) >> 1;
+		z[m][1] = (wi - ai) >> 1;
+	}
+}
+
+/* (1 - cos(2 pi n / FFT_SIZE)) / 2 */
+void fft_hann(q15_t x[FFT_SIZE])
+{
+	uint8_t n;
+
+	for (n = 0; n < FFT_SIZE; n++) {
+		const q15_t w = (Q15_ONE - fix_cos(n << (16 - FFT_LOG2))) >> 1;
+
+		x[n] = q15_mul(x[n], w);
+	}
+}
@@ -0,0 +1,30 @@
+#ifndef _FFT_H
+#define _FFT_H
+
+#include <stdint.h>
+
+#include "fixmath.h"
+
+/** Radix-2 fixed point FFT of a real block.
+ *
+ *  In place over FFT_SIZE real Q15 values: a complex transform of half the
+ *  size, decimation in time, takes the even samples as real parts and the
+ *  odd ones as imaginary parts, then a last pass splits it into the bins.
+ *  Every stage halves its outputs, so the result is the DFT divided by
+ *  FFT_SIZE and nothing can overflow. The twiddles are read from the sine
+ *  table of fixmath.c in flash, at its exact entries. 64 points take 80
+ *  butterflies and no SRAM beyond their own 128 bytes.
+ */
+
+#define FFT_LOG2 6
+#define FFT_SIZE (1 << FFT_LOG2)
+
+/** Forward transform of values of a magnitude below 1. x[2k] and x[2k + 1]
+ *  become the real and imaginary parts of bin k, 0 < k < FFT_SIZE / 2,
+ *  x[0] the real bin 0 and x[1] the real bin FFT_SIZE / 2. */
+void fft_real_q15(q15_t x[FFT_SIZE]);
+
+/** Hann window in place, its gain is one half */
+void fft_hann(q15_t x[FFT_SIZE]);
+
+#endif /* _FFT_H */
@@ -0,0 +1,121 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <avr/pgmspace.h>
+
+#include "filter.h"
+
+/* Q14 b0, b1, a1, a2 per log2 of the decimation, b2 is b0. b1 is rounded
+ * so that the DC gain is exactly one */
+static const int16_t biquad_coefs[][4] PROGMEM = {
+	{ 3384, 6770,  -6054,  3208 },
+	{ 1105, 2210, -18727,  6763 },
+	{  329,  658, -25576, 10508 },
+	{   91,  181, -29141, 13120 },
+	{   24,   48, -30950, 14662 },
+};
+
+void filter_init(struct filter *f, const enum FILTER_TYPE type,
+		uint8_t decimation)
+{
+	memset(f, 0, sizeof(*f));
+	f->type = type;
+	if (decimation > FILTER_MAX_DECIMATION)
+		decimation = FILTER_MAX_DECIMATION;
+	while (decimation >>= 1)
+		f->log2_decimation++;
+}
+
+static int16_t average_push(struct filter_average *a, const uint8_t pos,
+		const int16_t x)
+{
+	a->sum += (int32_t)x - a->history[pos];
+	a->history[pos] = x;
+	return a->sum >> FILTER_AVERAGE_LOG2;
+}
+
+static void cic_integrate(struct filter_cic *c, const int16_t x)
+{
+	uint32_t acc = x;
+	uint8_t i;
+
+	for (i = 0; i < FILTER_CIC_ORDER; i++)
+		acc = c->integrator[i] += acc;
+}
+
+static int16_t cic_comb(struct filter_cic *c, const uint8_t log2_decimation)
+{
+	uint32_t acc = c->integrator[FILTER_CIC_ORDER - 1];
+	uint8_t i;
+
+	for (i = 0; i < FILTER_CIC_ORDER; i++) {
+		const uint32_t delayed = c->comb[i];
+
+		c->comb[i] = acc;
+		acc -= delayed;
+	}
+	/* The gain is decimation^order */
+	return (int32_t)acc >> (FILTER_CIC_ORDER * log2_decimation);
+}
+
+static int16_t biquad_push(struct filter_biquad *b, const int16_t *coef,
+		const int16_t x)
+{
+	const int16_t b0 = pgm_read_word(&coef[0]);
+	int32_t acc = b->remainder;
+	int32_t y;
+
+	acc += (int32_t)b0 * ((int32_t)x + b->x2);
+	acc += (int32_t)(int16_t)pgm_read_word(&coef[1]) * b->x1;
+	acc -= (int32_t)(int16_t)pgm_read_word(&coef[2]) * b->y1;
+	acc -= (int32_t)(int16_t)pgm_read_word(&coef[3]) * b->y2;
+	y = acc >> 14;
+	b->remainder = acc - (y << 14);
+	/* The step response overshoots, don't let it wrap */
+	if (y > INT16_MAX)
+		y = INT16_MAX;
+	else if (y < INT16_MIN)
+		y = INT16_MIN;
+
+	b->x2 = b->x1;
+	b->x1 = x;
+	b->y2 = b->y1;
+	b->y1 = y;
+
+	return y;
+}
+
+bool filter_push(struct filter *f, const int16_t in[3], int16_t out[3])
+{
+	const bool publish = ++f->phase >> f->log2_decimation;
+	int16_t y[3];
+	uint8_t i;
+
+	if (publish)
+		f->phase = 0;
+
+	for (i = 0; i < 3; i++) {
+		switch (f->type) {
+			case FILTER_AVERAGE:
+				y[i] = average_push(&f->axis[i].average, f->pos, in[i]);
+				break;
+			case FILTER_CIC:
+				cic_integrate(&f->axis[i].cic, in[i]);
+				if (publish)
+					y[i] = cic_comb(&f->axis[i].cic, f->log2_decimation);
+				break;
+			case FILTER_BIQUAD:
+				y[i] = biquad_push(&f->axis[i].biquad,
+						biquad_coefs[f->log2_decimation], in[i]);
+				break;
+			default:
+				y[i] = in[i];
+				break;
+		}
+	}
+	f->pos = (f->pos + 1) & ((1 << FILTER_AVERAGE_LOG2) - 1);
+
+	if (publish)
+		memcpy(out, y, sizeof(y));
+	return publish;
+}
@@ -0,0 +1,65 @@
+#ifndef _FILTER_H
+#define _FILTER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/** Per-axis filtering and decimation of raw sensor vectors.
+ *
+ *  Runs at the sensor ODR and publishes every decimation-th input. All
+ *  types have unity gain at DC:
+ *  - FILTER_AVERAGE: moving average over the last 2^FILTER_AVERAGE_LOG2
+ *  - FILTER_CIC: FILTER_CIC_ORDER-stage CIC decimator
+ *  - FILTER_BIQUAD: Butterworth low-pass at ODR / (5 * decimation)
+ *  Decimation is a power of two up to FILTER_MAX_DECIMATION.
+ */
+
+enum FILTER_TYPE {
+	FILTER_NONE,
+	FILTER_AVERAGE,
+	FILTER_CIC,
+	FILTER_BIQUAD
+};
+
+#define FILTER_AVERAGE_LOG2   3
+#define FILTER_CIC_ORDER      3
+#define FILTER_MAX_DECIMATION 16
+
+struct filter_average {
+	int16_t history[1 << FILTER_AVERAGE_LOG2];
+	int32_t sum;
+};
+
+struct filter_cic {
+	/* Wrap around on purpose, the combs cancel it */
+	uint32_t integrator[FILTER_CIC_ORDER];
+	uint32_t comb[FILTER_CIC_ORDER];
+};
+
+struct filter_biquad {
+	int16_t x1, x2, y1, y2;
+	int16_t remainder;  /* of the output rounding, fed back */
+};
+
+struct filter {
+	uint8_t type;
+	uint8_t log2_decimation;
+	uint8_t phase;
+	uint8_t pos;
+	union {
+		struct filter_average average;
+		struct filter_cic cic;
+		struct filter_biquad biquad;
+	} axis[3];
+};
+
+/** Resets the state, decimation is rounded down to a power of two */
+void filter_init(struct filter *f, const enum FILTER_TYPE type,
+		uint8_t decimation);
+
+/** Feeds a sample, in and out may be the same vector
+ *  @return true when an output was published to out
+ */
+bool filter_push(struct filter *f, const int16_t in[3], int16_t out[3]);
+
+#endif /* _FILTER_H */
@@ -0,0 +1,146 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <avr/pgmspace.h>
+
+#include "fixmath.h"
+
+/* First quadrant of the sine in 128 steps */
+static const q15_t sin_table[129] PROGMEM = {
+	0, 402, 804, 1206, 1608, 2009, 2410, 2811, 3212, 3612,
+	4011, 4410, 4808, 5205, 5602, 5998, 6393, 6786, 7179, 7571,
+	7962, 8351, 8739, 9126, 9512, 9896, 10278, 10659, 11039, 11417,
+	11793, 12167, 12539, 12910, 13279, 13645, 14010, 14372, 14732, 15090,
+	15446, 15800, 16151, 16499, 16846, 17189, 17530, 17869, 18204, 18537,
+	18868, 19195, 19519, 19841, 20159, 20475, 20787, 21096, 21403, 21705,
+	22005, 22301, 22594, 22884, 23170, 23452, 23731, 24007, 24279, 24547,
+	24811, 25072, 25329, 25582, 25832, 26077, 26319, 26556, 26790, 27019,
+	27245, 27466, 27683, 27896, 28105, 28310, 28510, 28706, 28898, 29085,
+	29268, 29447, 29621, 29791, 29956, 30117, 30273, 30424, 30571, 30714,
+	30852, 30985, 31113, 31237, 31356, 31470, 31580, 31685, 31785, 31880,
+	31971, 32057, 32137, 32213, 32285, 32351, 32412, 32469, 32521, 32567,
+	32609, 32646, 32678, 32705, 32728, 32745, 32757, 32765, 32767,
+};
+
+/* atan(i / 64) as an angle */
+static const uint16_t atan_table[65] PROGMEM = {
+	0, 163, 326, 489, 651, 813, 975, 1136, 1297, 1457, 1617, 1775,
+	1933, 2090, 2246, 2401, 2555, 2708, 2860, 3010, 3159, 3307, 3453, 3599,
+	3742, 3884, 4025, 4164, 4302, 4438, 4572, 4705, 4836, 4966, 5094, 5220,
+	5344, 5467, 5589, 5708, 5826, 5943, 6058, 6171, 6282, 6392, 6500, 6607,
+	6712, 6815, 6917, 7018, 7117, 7214, 7310, 7405, 7498, 7589, 7679, 7768,
+	7856, 7942, 8026, 8110, 8192,
+};
+
+q15_t fix_sin(const uint16_t angle)
+{
+	/* Position within the quadrant, mirrored on the falling ones */
+	uint16_t x = angle & 0x3fff;
+	uint8_t i, frac;
+	q15_t s0, s1, s;
+
+	if (angle & 0x4000)
+		x = 0x4000 - x;
+	i = x >> 7;
+	frac = x & 0x7f;
+	s0 = pgm_read_word(&sin_table[i]);
+	s = s0;
+	if (frac) {
+		s1 = pgm_read_word(&sin_table[i + 1]);
+		s += ((int16_t)(s1 - s0) * frac) >> 7;
+	}
+
+	return angle & 0x8000? -s: s;
+}
+
+/* z is the ratio in [0, 1] scaled by 32768 */
+static uint16_t atan_unit(const uint16_t z)
+{
+	const uint8_t i = z >> 9;
+	const uint16_t frac = z & 0x1ff;
+	const uint16_t a0 = pgm_read_word(&atan_table[i]);
+
+	if (!frac)
+		return a0;
+	return a0 + (((uint32_t)(pgm_read_word(&atan_table[i + 1]) - a0) *
+				frac) >> 9);
+}
+
+uint16_t fix_atan2(int32_t y, int32_t x)
+{
+	uint32_t ax = labs(x), ay = labs(y);
+	uint16_t a;
+
+	if (!ax && !ay)
+		return 0;
+	/* The ratio is taken on 16 bits */
+	while ((ax | ay) >> 16) {
+		ax >>= 1;
+		ay >>= 1;
+	}
+
+	if (ay <= ax)
+		a = atan_unit((ay << 15) / ax);
+	else
+		a = 0x4000 - atan_unit((ax << 15) / ay);
+	if (x < 0)
+		a = 0x8000 - a;
+	if (y < 0)
+		a = -a;
+
+	return a;
+}
+
+uint16_t fix_sqrt(uint32_t x)
+{
+	uint32_t root = 0, bit = 1UL << 30;
+
+	while (bit > x)
+		bit >>= 2;
+	while (bit) {
+		if (x >= root + bit) {
+			x -= root + bit;
+			root = (root >> 1) + bit;
+		} else {
+			root >>= 1;
+		}
+		bit >>= 2;
+	}
+
+	return root;
+}
+
+/* From the sine table, Q15 halved */
+static q14_t q14_sin(const uint16_t angle)
+{
+	return (fix_sin(angle) + 1) >> 1;
+}
+
+void fix_rotation(struct fix_mat3 *r, const int16_t roll,
+		const int16_t pitch, const uint16_t heading)
+{
+	const q14_t sr = q14_sin(roll), cr = q14_sin(roll + 0x4000);
+	const q14_t sp = q14_sin(pitch), cp = q14_sin(pitch + 0x4000);
+	const q14_t sh = q14_sin(heading), ch = q14_sin(heading + 0x4000);
+	const q14_t ch_sp = q14_mul(ch, sp), sh_sp = q14_mul(sh, sp);
+
+	/* Rz(heading) Ry(pitch) Rx(roll) */
+	r->m[0][0] = q14_mul(ch, cp);
+	r->m[0][1] = q14_mul(ch_sp, sr) - q14_mul(sh, cr);
+	r->m[0][2] = q14_mul(ch_sp, cr) + q14_mul(sh, sr);
+	r->m[1][0] = q14_mul(sh, cp);
+	r->m[1][1] = q14_mul(sh_sp, sr) + q14_mul(ch, cr);
+	r->m[1][2] = q14_mul(sh_sp, cr) - q14_mul(ch, sr);
+	r->m[2][0] = -sp;
+	r->m[2][1] = q14_mul(cp, sr);
+	r->m[2][2] = q14_mul(cp, cr);
+}
+
+void fix_mat3_apply(const struct fix_mat3 *r, const int16_t v[3],
+		int16_t out[3])
+{
+	uint8_t i;
+
+	for (i = 0; i < 3; i++)
+		out[i] = ((int32_t)r->m[i][0] * v[0] + (int32_t)r->m[i][1] * v[1] +
+				(int32_t)r->m[i][2] * v[2] + (1 << 13)) >> 14;
+}
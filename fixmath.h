@@ -0,0 +1,64 @@
+#ifndef _FIXMATH_H
+#define _FIXMATH_H
+
+#include <stdint.h>
+
+/** Fixed point helpers for the integer signal path.
+ *
+ *  Angles are binary: 65536 is a full turn, so they wrap for free and the
+ *  int16_t difference of two angles is the signed error between them.
+ *  Q15 values are int16_t fractions in [-1, 1). Q1.14 ones are in [-2, 2),
+ *  which holds a rotation matrix entry of exactly 1.
+ */
+
+typedef int16_t q15_t;
+typedef int16_t q14_t;
+
+#define Q15_ONE 32767
+#define Q14_ONE 16384
+
+/** Rotation matrix, m[row][column] */
+struct fix_mat3 {
+	q14_t m[3][3];
+};
+
+#define DEG_TO_ANGLE(deg) ((int16_t)((deg) * 65536L / 360))
+
+static inline q15_t q15_mul(const q15_t a, const q15_t b)
+{
+	return ((int32_t)a * b) >> 15;
+}
+
+static inline q14_t q14_mul(const q14_t a, const q14_t b)
+{
+	return ((int32_t)a * b + (1 << 13)) >> 14;
+}
+
+/** @return angle in tenths of a degree, for printing */
+static inline int16_t angle_to_ddeg(const int16_t angle)
+{
+	return ((int32_t)angle * 3600) >> 16;
+}
+
+q15_t fix_sin(const uint16_t angle);
+
+static inline q15_t fix_cos(const uint16_t angle)
+{
+	return fix_sin(angle + 0x4000);
+}
+
+/** Four quadrant arctangent, within 2 LSB (0.01 degree) */
+uint16_t fix_atan2(int32_t y, int32_t x);
+
+uint16_t fix_sqrt(uint32_t x);
+
+/** Body to world rotation of an attitude: roll about x, then pitch about
+ *  y, then heading about z, as in fusion.h */
+void fix_rotation(struct fix_mat3 *r, const int16_t roll,
+		const int16_t pitch, const uint16_t heading);
+
+/** out = r v, rounded */
+void fix_mat3_apply(const struct fix_mat3 *r, const int16_t v[3],
+		int16_t out[3]);
+
+#endif /* _FIXMATH_H */
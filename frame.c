@@ -0,0 +1,108 @@
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "frame.h"
+
+uint16_t frame_crc16(uint16_t crc, const uint8_t *data, uint8_t n)
+{
+	while (n--) {
+		/* Same as _crc_ccitt_update from avr-libc */
+		uint8_t x = *data++ ^ (crc & 0xff);
+		x ^= x << 4;
+		crc = ((uint16_t)x << 8 | crc >> 8) ^ (uint8_t)(x >> 4) ^
+			((uint16_t)x << 3);
+	}
+
+	return crc;
+}
+
+static inline uint8_t frame_byte(const uint8_t *payload, const uint8_t n,
+		const uint16_t crc, const uint8_t i)
+{
+	if (i < n)
+		return payload[i];
+
+	return i == n? crc & 0xff: crc >> 8;
+}
+
+bool frame_send(frame_put_t put, const uint8_t *payload, const uint8_t n)
+{
+	const uint16_t crc = frame_crc16(0xffff, payload, n);
+	const uint8_t N = n + 2;
+	uint8_t i = 0;
+
+	if (n > FRAME_MAX_PAYLOAD)
+		return false;
+
+	put(0);
+	while (i <= N) {
+		uint8_t j = i;
+
+		/* Length of the group up to the next zero or the end */
+		while (j < N && frame_byte(payload, n, crc, j))
+			j++;
+		put(j - i + 1);
+		for (; i < j; i++)
+			put(frame_byte(payload, n, crc, i));
+		/* Skip the zero replaced by the code */
+		i++;
+	}
+	put(0);
+
+	return true;
+}
+
+void frame_decoder_init(struct frame_decoder *d, uint8_t *buf,
+		const uint8_t size)
+{
+	d->buf = buf;
+	d->size = size;
+	frame_decoder_reset(d);
+}
+
+void frame_decoder_reset(struct frame_decoder *d)
+{
+	d->len = 0;
+	d->code = 0;
+	d->left = 0;
+	d->overflow = false;
+}
+
+int frame_decode(struct frame_decoder *d, const uint8_t c)
+{
+	int ret = 0;
+
+	if (!c) {
+		if (d->len || d->code) {
+			/* A complete frame ends right after its last group */
+			if (d->left || d->overflow || d->len < 2 ||
+					frame_crc16(0xffff, d->buf, d->len))
+				ret = -1;
+			else
+				ret = d->len - 2;
+		}
+		frame_decoder_reset(d);
+		return ret;
+	}
+
+	if (d->left) {
+		if (d->len < d->size)
+			d->buf[d->len++] = c;
+		else
+			d->overflow = true;
+		d->left--;
+		return 0;
+	}
+
+	/* A new group, the previous one stood for a zero unless it was full */
+	if (d->code && d->code != 0xff) {
+		if (d->len < d->size)
+			d->buf[d->len++] = 0;
+		else
+			d->overflow = true;
+	}
+	d->code = c;
+	d->left = c - 1;
+
+	return 0;
+}
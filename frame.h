@@ -0,0 +1,48 @@
+#ifndef _FRAME_H
+#define _FRAME_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/** COBS framing with a CRC-16/CCITT trailer.
+ *
+ *  Hardware independent, shared by the firmware and the host tools.
+ *  On the wire a frame is | 0x00 | COBS(payload, crc16 LE) | 0x00 |, the
+ *  leading delimiter separates it from any plain text sent in between.
+ */
+
+/* Longest payload, keeps the COBS code of a frame in a single group */
+#define FRAME_MAX_PAYLOAD 240
+
+typedef void (*frame_put_t)(const uint8_t c);
+
+uint16_t frame_crc16(uint16_t crc, const uint8_t *data, uint8_t n);
+
+/** Encodes and emits a frame byte by byte, no buffer is needed.
+ *  @return false if the payload is too long
+ */
+bool frame_send(frame_put_t put, const uint8_t *payload, const uint8_t n);
+
+struct frame_decoder {
+	uint8_t len;     /* bytes decoded so far */
+	uint8_t code;    /* current COBS code */
+	uint8_t left;    /* bytes left in the current group */
+	bool overflow;
+	uint8_t size;
+	uint8_t *buf;    /* payload and CRC */
+};
+
+/** Sets up a decoder for frames of up to size - 2 payload bytes, so the
+ *  firmware can keep small buffers */
+void frame_decoder_init(struct frame_decoder *d, uint8_t *buf,
+		const uint8_t size);
+
+void frame_decoder_reset(struct frame_decoder *d);
+
+/** Feeds a byte of the stream to the decoder.
+ *  @return payload length once a frame with a good CRC has been completed,
+ *  0 while in the middle of a frame and -1 for a corrupt frame
+ */
+int frame_decode(struct frame_decoder *d, const uint8_t c);
+
+#endif /* _FRAME_H */
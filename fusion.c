@@ -0,0 +1,105 @@
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "fusion.h"
+#include "fixmath.h"
+#include "perf.h"
+
+/* A micro deg/s as a 2^32 angle per second is 2^32 / 360e6 */
+#define GYRO_UDPS_ANGLE_1000 11930UL
+
+/* Attitude on 32 bits so slow rates don't vanish in the integration */
+static uint32_t roll, pitch, yaw;
+static uint16_t gyro_k;
+static uint8_t gyro_shift;
+static bool acc_seen, mag_seen;
+
+void fusion_set_gyro(const uint16_t gyro_odr, const uint16_t gyro_scale)
+{
+	const uint32_t lsb = gyro_scale * GYRO_UDPS_ANGLE_1000 / 1000;
+
+	/* Angle per LSB and sample, as precise as 16 bits allow so that
+	 * it can be multiplied by a sample without overflowing */
+	gyro_shift = 0;
+	while (gyro_shift < 12 && ((lsb << (gyro_shift + 1)) / gyro_odr) >> 16 == 0)
+		gyro_shift++;
+	gyro_k = (lsb << gyro_shift) / gyro_odr;
+}
+
+void init_fusion(const uint16_t gyro_odr, const uint16_t gyro_scale)
+{
+	fusion_set_gyro(gyro_odr, gyro_scale);
+	roll = pitch = yaw = 0;
+	acc_seen = mag_seen = false;
+}
+
+static int32_t gyro_step(const int16_t rate, const uint8_t n)
+{
+	return (((int32_t)rate * gyro_k) >> gyro_shift) * n;
+}
+
+void fusion_gyro(const int16_t v[3], const uint8_t n)
+{
+	PERF_START16(t);
+
+	roll += gyro_step(v[0], n);
+	pitch += gyro_step(v[1], n);
+	yaw += gyro_step(v[2], n);
+
+	PERF_STOP16(fusion, t);
+	PERF_INC(fusion_updates);
+}
+
+/* Moves an angle towards a measurement, snapping to the first one */
+static void correct(uint32_t *angle, const uint16_t measured,
+		const uint8_t shift, const bool seen)
+{
+	const int32_t error = ((uint32_t)measured << 16) - *angle;
+
+	*angle += seen? error >> shift: error;
+}
+
+void fusion_acc(const int16_t v[3])
+{
+	const int32_t ax = v[0], ay = v[1], az = v[2];
+	const uint32_t yz = (uint32_t)(ay * ay) + (uint32_t)(az * az);
+	const uint32_t g2 = (uint32_t)(ax * ax) + yz;
+	PERF_START16(t);
+
+	if (g2 < (uint32_t)FUSION_ACC_1G * FUSION_ACC_1G * 9 / 16 ||
+			g2 > (uint32_t)FUSION_ACC_1G * FUSION_ACC_1G * 25 / 16)
+		return;
+
+	correct(&roll, fix_atan2(ay, az), FUSION_ACC_SHIFT, acc_seen);
+	correct(&pitch, fix_atan2(-ax, fix_sqrt(yz)), FUSION_ACC_SHIFT, acc_seen);
+	acc_seen = true;
+
+	PERF_STOP16(fusion, t);
+	PERF_INC(fusion_updates);
+}
+
+void fusion_compass(const int16_t m[3])
+{
+	const q15_t sr = fix_sin(roll >> 16), cr = fix_cos(roll >> 16);
+	const q15_t sp = fix_sin(pitch >> 16), cp = fix_cos(pitch >> 16);
+	int32_t z, xh, yh;
+	PERF_START16(t);
+
+	/* Back to level: undo the roll, then the pitch */
+	z = ((int32_t)m[1] * sr + (int32_t)m[2] * cr) >> 15;
+	yh = ((int32_t)m[1] * cr - (int32_t)m[2] * sr) >> 15;
+	xh = ((int32_t)m[0] * cp + z * sp) >> 15;
+
+	correct(&yaw, fix_atan2(-yh, xh), FUSION_MAG_SHIFT, mag_seen);
+	mag_seen = true;
+
+	PERF_STOP16(fusion, t);
+	PERF_INC(fusion_updates);
+}
+
+void fusion_get(struct attitude *a)
+{
+	a->roll = roll >> 16;
+	a->pitch = pitch >> 16;
+	a->heading = yaw >> 16;
+}
@@ -0,0 +1,47 @@
+#ifndef _FUSION_H
+#define _FUSION_H
+
+#include <stdint.h>
+
+/** Integer attitude estimation.
+ *
+ *  Complementary filter: gyro rates are integrated at their native ODR,
+ *  the accelerometer pulls roll and pitch towards gravity and the tilt
+ *  compensated compass pulls the heading towards magnetic north.
+ *  All axes are in the accelerometer frame, z up when level. Angles are
+ *  binary (see fixmath.h) and right handed about x, y and z.
+ */
+
+/* Correction gains as shifts, the time constant is 2^shift samples */
+#define FUSION_ACC_SHIFT 6
+#define FUSION_MAG_SHIFT 5
+
+/* Accelerometer LSB per g, samples off by more than 25% are not trusted
+ * to be gravity */
+#define FUSION_ACC_1G 256
+
+struct attitude {
+	int16_t roll;
+	int16_t pitch;
+	uint16_t heading;
+};
+
+/** @param gyro_odr gyro output data rate in Hz
+ *  @param gyro_scale micro deg/s per LSB, see sensor_scale()
+ */
+void init_fusion(const uint16_t gyro_odr, const uint16_t gyro_scale);
+
+/** Changes the gyro scale, keeping the attitude */
+void fusion_set_gyro(const uint16_t gyro_odr, const uint16_t gyro_scale);
+
+/** Integrates a raw gyro sample standing for n periods of the ODR */
+void fusion_gyro(const int16_t v[3], const uint8_t n);
+
+void fusion_acc(const int16_t v[3]);
+
+/** @param m field as x, y, z, any gain */
+void fusion_compass(const int16_t m[3]);
+
+void fusion_get(struct attitude *a);
+
+#endif /* _FUSION_H */
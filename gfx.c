@@ -0,0 +1,85 @@
+#include <string.h>
+#include <avr/pgmspace.h>
+
+#include "gfx.h"
+
+/* Pages the buffer holds */
+static uint8_t band_first = 0, band_pages = GFX_HEIGHT / 8;
+
+void gfx_set_band(const uint8_t first, const uint8_t pages)
+{
+	band_first = first;
+	band_pages = pages;
+}
+
+void putpixel(uint8_t b[], uint8_t x, uint8_t y, bool set)
+{
+	/* Wraps above the band */
+	const uint8_t page = (y >> 3) - band_first;
+
+	if (x < GFX_WIDTH && y < GFX_HEIGHT && page < band_pages) {
+		const uint8_t MASK = 1 << (y & 7);
+		const uint16_t pos = page * GFX_WIDTH + x;
+		if (set)
+			b[pos] |= MASK;
+		else
+			b[pos] &= ~MASK;
+	}
+}
+
+void line(uint8_t b[], long x0, long y0, long x1, long y1)
+{
+	long incx = (x1 > x0)? 1: -1;
+	long incy = (y1 > y0)? 1: -1;
+	const long dx = ((long)x1 - x0)*incx;
+	const long dy = ((long)y0 - y1)*incy;
+	long e = dx + dy;
+	const long top = band_first * 8, bottom = top + band_pages * 8;
+
+	if ((y0 < top && y1 < top) || (y0 >= bottom && y1 >= bottom))
+		return;
+	while ((x0 != x1) || (y0 != y1)) {
+		const long double_e = e << 1;
+		if (x0 > 0 && y0 >0 && x0 <127 && y0 < 63)
+			putpixel(b, x0, y0, true);
+		if (double_e >= dy) {
+			e += dy;
+			x0 += incx;
+		}
+		if (double_e <= dx) {
+			e += dx;
+			y0 += incy;
+		}
+	}
+}
+
+void gfx_clear(uint8_t b[])
+{
+	memset(b, 0, band_pages * GFX_WIDTH);
+}
+
+void gfx_blit_P(uint8_t b[], const uint8_t *img)
+{
+	memcpy_P(b, img + band_first * GFX_WIDTH, band_pages * GFX_WIDTH);
+}
+
+void gfx_fill(uint8_t b[], const uint8_t x, const uint8_t y, const uint8_t w,
+		const uint8_t h)
+{
+	const uint8_t end = y + h;
+	uint8_t page, i;
+
+	for (page = 0; page < band_pages; page++) {
+		const uint8_t top = (band_first + page) * 8;
+		uint8_t mask = 0xff;
+
+		if (end <= top || y >= top + 8)
+			continue;
+		if (y > top)
+			mask <<= y - top;
+		if (end < top + 8)
+			mask &= 0xff >> (top + 8 - end);
+		for (i = x; i < x + w && i < GFX_WIDTH; i++)
+			b[page * GFX_WIDTH + i] |= mask;
+	}
+}
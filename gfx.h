@@ -0,0 +1,40 @@
+#ifndef _GFX_H
+#define _GFX_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/** Drawing primitives on the SSD1306 framebuffer.
+ *
+ *  The buffer is in display RAM order: 8 pages of 128 columns, one byte
+ *  holds 8 vertical pixels with the top one in bit 0.
+ *  See bench/gfx_bench.c before changing any of these.
+ *
+ *  The buffer may hold a band of pages only, see gfx_set_band(): the
+ *  coordinates stay those of the screen and drawing is clipped to the
+ *  band, so a frame can be drawn band by band into little RAM.
+ */
+
+#define GFX_WIDTH  128
+#define GFX_HEIGHT 64
+#define GFX_SIZE   (GFX_WIDTH * GFX_HEIGHT / 8)
+
+/** Pages first to first + pages - 1 from now on, the whole screen
+ *  until called */
+void gfx_set_band(const uint8_t first, const uint8_t pages);
+
+void putpixel(uint8_t b[], uint8_t x, uint8_t y, bool set);
+
+/** Bresenham line, the border pixels are left untouched */
+void line(uint8_t b[], long x0, long y0, long x1, long y1);
+
+void gfx_clear(uint8_t b[]);
+
+/** Copies a full screen image from flash, the band of it */
+void gfx_blit_P(uint8_t b[], const uint8_t *img);
+
+/** Sets the pixels of a rectangle, y + h up to GFX_HEIGHT */
+void gfx_fill(uint8_t b[], const uint8_t x, const uint8_t y, const uint8_t w,
+		const uint8_t h);
+
+#endif /* _GFX_H */
@@ -0,0 +1,75 @@
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "gyro.h"
+#include "sensor.h"
+#include "clock.h"
+
+#define GYRO_CTRL_REG1 0x20
+
+/* Two FIFOs at the lowest ODR without a new sample: the gyro is off,
+ * missing or not answering */
+#define GYRO_CAL_TIMEOUT_US (2 * GYRO_FIFO_SIZE * 10000UL)
+
+static int16_t bias[3];
+
+uint16_t init_gyro(const uint16_t odr)
+{
+	uint8_t dr = 0, ctrl1;
+
+	while (dr < 3 && (200U << dr) <= odr)
+		dr++;
+
+	sensor_init(SENSOR_ID_GYRO);
+	/* Lowest bandwidth of the ODR, normal mode, all axes */
+	ctrl1 = dr << 6 | 0x0f;
+	sensor_write(SENSOR_ID_GYRO, GYRO_CTRL_REG1, 1, &ctrl1);
+
+	return 100 << dr;
+}
+
+void gyro_set_bias(const int16_t b[3])
+{
+	bias[0] = b[0];
+	bias[1] = b[1];
+	bias[2] = b[2];
+}
+
+bool gyro_calibrate(int16_t b[3])
+{
+	int32_t sum[3] = { 0, 0, 0 };
+	int16_t v[8][3];
+	uint32_t last = clock_us();
+	uint8_t got = 0, i, n;
+
+	while (got < GYRO_FIFO_SIZE) {
+		n = sensor_read(SENSOR_ID_GYRO, v, GYRO_FIFO_SIZE - got < 8?
+				GYRO_FIFO_SIZE - got: 8);
+		if (!n) {
+			if (clock_us() - last > GYRO_CAL_TIMEOUT_US)
+				return false;
+			continue;
+		}
+		last = clock_us();
+		for (i = 0; i < n; i++) {
+			sum[0] += v[i][0];
+			sum[1] += v[i][1];
+			sum[2] += v[i][2];
+		}
+		got += n;
+	}
+	for (i = 0; i < 3; i++)
+		b[i] = bias[i] = sum[i] / GYRO_FIFO_SIZE;
+	return true;
+}
+
+void gyro_correct(int16_t v[][3], const uint8_t n)
+{
+	uint8_t i;
+
+	for (i = 0; i < n; i++) {
+		v[i][0] -= bias[0];
+		v[i][1] -= bias[1];
+		v[i][2] -= bias[2];
+	}
+}
@@ -0,0 +1,36 @@
+#ifndef _GYRO_H
+#define _GYRO_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/** L3G4200D gyro.
+ *
+ *  The chip runs its FIFO in stream mode, so samples taken between two
+ *  polls queue up there at the full ODR and sensor_read() drains them in
+ *  one burst (see sensor.h). The FIFO holds 32 samples: 320 ms at 100 Hz
+ *  but only 40 ms at 800 Hz, polls further apart than that lose the
+ *  oldest samples.
+ */
+
+#define GYRO_FIFO_SIZE 32
+
+/** Powers the gyro up with its FIFO in stream mode
+ *  @param odr output data rate in Hz, rounded down to 100, 200, 400 or 800
+ *  @return the ODR in use
+ */
+uint16_t init_gyro(const uint16_t odr);
+
+/** Averages a FIFO worth of samples as the zero rate offset, the board
+ *  must be at rest meanwhile
+ *  @param bias the new offset, in raw LSB, left alone on failure
+ *  @return false if the samples stopped coming for 640 ms
+ */
+bool gyro_calibrate(int16_t bias[3]);
+
+void gyro_set_bias(const int16_t bias[3]);
+
+/** Removes the zero rate offset */
+void gyro_correct(int16_t v[][3], const uint8_t n);
+
+#endif /* _GYRO_H */
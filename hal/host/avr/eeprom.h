@@ -0,0 +1,16 @@
+#ifndef _HAL_AVR_EEPROM_H
+#define _HAL_AVR_EEPROM_H
+
+/* The EEPROM lives in sim.c, addresses are offsets into it */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define E2END 0x3ff
+#define EEMEM
+
+uint8_t eeprom_read_byte(const uint8_t *p);
+void eeprom_read_block(void *dst, const void *src, size_t n);
+void eeprom_update_block(const void *src, void *dst, size_t n);
+
+#endif /* _HAL_AVR_EEPROM_H */
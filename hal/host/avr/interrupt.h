@@ -0,0 +1,19 @@
+#ifndef _HAL_AVR_INTERRUPT_H
+#define _HAL_AVR_INTERRUPT_H
+
+#include <avr/io.h>
+
+/* Vectors are plain functions, sim.c calls the ones that exist */
+#define ISR(vector, ...) \
+	void vector(void); \
+	void vector(void)
+
+#define ISR_BLOCK
+#define ISR_NOBLOCK
+#define ISR_NAKED
+
+#define sei() sim_sei()
+#define cli() sim_cli()
+#define reti() return
+
+#endif /* _HAL_AVR_INTERRUPT_H */
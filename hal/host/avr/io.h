@@ -0,0 +1,194 @@
+#ifndef _HAL_AVR_IO_H
+#define _HAL_AVR_IO_H
+
+/* ATmega328P I/O registers and bits for the host HAL, see hal.h */
+
+#include <stdint.h>
+
+#include "../sim.h"
+
+#define _BV(bit) (1 << (bit))
+
+#define bit_is_set(sfr, bit)   ((sfr) & _BV(bit))
+#define bit_is_clear(sfr, bit) (!((sfr) & _BV(bit)))
+
+#define RAMEND 0x8ff
+#define E2END  0x3ff
+
+extern volatile uint8_t SREG;
+
+/* Ports */
+extern volatile uint8_t PINB, DDRB, PORTB;
+extern volatile uint8_t PINC, DDRC, PORTC;
+extern volatile uint8_t PORTD;
+/* PD6 and PD7 carry the bit-banged I2C bus */
+#define DDRD (*sim_ddrd())
+#define PIND (*sim_pind())
+
+/* External interrupts */
+extern volatile uint8_t EICRA, EIMSK, EIFR, PCICR, PCIFR;
+extern volatile uint8_t PCMSK0, PCMSK1, PCMSK2;
+
+/* Power and sleep */
+extern volatile uint8_t SMCR, MCUSR, MCUCR, PRR, WDTCSR;
+
+/* Timer0 and Timer2, simulated in CTC mode, only the Timer2 counter is
+ * read back */
+extern volatile uint8_t TCCR0A, TCCR0B, TCNT0, OCR0A, OCR0B, TIMSK0, TIFR0;
+extern volatile uint8_t TCCR2A, TCCR2B, OCR2A, OCR2B, TIMSK2, TIFR2;
+#define TCNT2 (*sim_tcnt2())
+
+/* Timer1, the counter is derived from the simulated time */
+extern volatile uint8_t TCCR1A, TCCR1B, TCCR1C, TIMSK1;
+extern volatile uint16_t OCR1A, OCR1B, ICR1;
+#define TCNT1 (*sim_tcnt1())
+#define TIFR1 (*sim_tifr1())
+
+/* USART0 */
+extern volatile uint8_t UBRR0H, UBRR0L, UCSR0C;
+#define UCSR0A (*sim_ucsr0a())
+#define UCSR0B (*sim_ucsr0b())
+#define UDR0   (*sim_udr0())
+
+/* TWI, only TWCR has side effects */
+extern volatile uint8_t TWBR, TWSR, TWAR, TWDR, TWAMR;
+#define TWCR (*sim_twcr())
+
+/* EEPROM */
+extern volatile uint8_t EECR, EEDR;
+extern volatile uint16_t EEAR;
+
+/* SREG */
+#define SREG_C 0
+#define SREG_Z 1
+#define SREG_N 2
+#define SREG_V 3
+#define SREG_S 4
+#define SREG_H 5
+#define SREG_T 6
+#define SREG_I 7
+
+/* Ports */
+#define PB0 0
+#define PB1 1
+#define PB2 2
+#define PB3 3
+#define PB4 4
+#define PB5 5
+#define PC0 0
+#define PC1 1
+#define PC2 2
+#define PC3 3
+#define PC4 4
+#define PC5 5
+#define PD0 0
+#define PD1 1
+#define PD2 2
+#define PD3 3
+#define PD4 4
+#define PD5 5
+#define PD6 6
+#define PD7 7
+
+/* EICRA, EIMSK, EIFR, PCICR */
+#define ISC00 0
+#define ISC01 1
+#define ISC10 2
+#define ISC11 3
+#define INT0  0
+#define INT1  1
+#define INTF0 0
+#define INTF1 1
+#define PCIE0 0
+#define PCIE1 1
+#define PCIE2 2
+
+/* SMCR */
+#define SE  0
+#define SM0 1
+#define SM1 2
+#define SM2 3
+
+/* TCCR0A/B, TIMSK0, TIFR0 */
+#define WGM00  0
+#define WGM01  1
+#define WGM02  3
+#define CS00   0
+#define CS01   1
+#define CS02   2
+#define TOIE0  0
+#define OCIE0A 1
+#define OCIE0B 2
+#define TOV0   0
+#define OCF0A  1
+#define OCF0B  2
+
+/* TCCR1A/B, TIMSK1, TIFR1 */
+#define WGM10  0
+#define WGM11  1
+#define WGM12  3
+#define WGM13  4
+#define CS10   0
+#define CS11   1
+#define CS12   2
+#define TOIE1  0
+#define OCIE1A 1
+#define OCIE1B 2
+#define TOV1   0
+#define OCF1A  1
+#define OCF1B  2
+
+/* TCCR2A/B, TIMSK2, TIFR2 */
+#define WGM20  0
+#define WGM21  1
+#define WGM22  3
+#define CS20   0
+#define CS21   1
+#define CS22   2
+#define TOIE2  0
+#define OCIE2A 1
+#define OCIE2B 2
+#define TOV2   0
+#define OCF2A  1
+#define OCF2B  2
+
+/* UCSR0A/B/C */
+#define MPCM0  0
+#define U2X0   1
+#define UPE0   2
+#define DOR0   3
+#define FE0    4
+#define UDRE0  5
+#define TXC0   6
+#define RXC0   7
+#define TXB80  0
+#define RXB80  1
+#define UCSZ02 2
+#define TXEN0  3
+#define RXEN0  4
+#define UDRIE0 5
+#define TXCIE0 6
+#define RXCIE0 7
+#define UCPOL0 0
+#define UCSZ00 1
+#define UCSZ01 2
+#define USBS0  3
+
+/* TWCR, TWSR */
+#define TWIE  0
+#define TWEN  2
+#define TWWC  3
+#define TWSTO 4
+#define TWSTA 5
+#define TWEA  6
+#define TWINT 7
+#define TWPS0 0
+#define TWPS1 1
+
+/* EECR */
+#define EERE  0
+#define EEPE  1
+#define EEMPE 2
+#define EERIE 3
+
+#endif /* _HAL_AVR_IO_H */
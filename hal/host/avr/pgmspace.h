@@ -0,0 +1,32 @@
+#ifndef _HAL_AVR_PGMSPACE_H
+#define _HAL_AVR_PGMSPACE_H
+
+/* There is a single address space on the host */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#define PROGMEM
+#define PGM_P const char *
+#define PSTR(s) (s)
+
+#define pgm_read_byte(p)  (*(const uint8_t *)(p))
+#define pgm_read_word(p)  (*(const uint16_t *)(p))
+#define pgm_read_dword(p) (*(const uint32_t *)(p))
+#define pgm_read_float(p) (*(const float *)(p))
+#define pgm_read_ptr(p)   (*(void * const *)(p))
+
+#define memcpy_P  memcpy
+#define strcpy_P  strcpy
+#define strcmp_P  strcmp
+#define strncmp_P strncmp
+#define strlen_P  strlen
+#define strchr_P  strchr
+
+#define printf_P   printf
+#define sprintf_P  sprintf
+#define fprintf_P  fprintf
+#define vfprintf_P vfprintf
+
+#endif /* _HAL_AVR_PGMSPACE_H */
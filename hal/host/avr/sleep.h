@@ -0,0 +1,24 @@
+#ifndef _HAL_AVR_SLEEP_H
+#define _HAL_AVR_SLEEP_H
+
+/* Idle mode only: sleep_cpu() lets time pass until an interrupt has been
+ * taken, see sim.c */
+
+#include <avr/io.h>
+
+#define SLEEP_MODE_IDLE 0
+
+#define set_sleep_mode(mode) \
+	(SMCR = (SMCR & ~(_BV(SM0) | _BV(SM1) | _BV(SM2))) | (mode))
+#define sleep_enable()  (SMCR |= _BV(SE))
+#define sleep_disable() (SMCR &= ~_BV(SE))
+#define sleep_cpu()     sim_sleep()
+
+#define sleep_mode() \
+	do { \
+		sleep_enable(); \
+		sleep_cpu(); \
+		sleep_disable(); \
+	} while (0)
+
+#endif /* _HAL_AVR_SLEEP_H */
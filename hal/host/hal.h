@@ -0,0 +1,28 @@
+#ifndef _HAL_H
+#define _HAL_H
+
+/** Host HAL.
+ *
+ *  The firmware is built for Linux against the headers in this directory,
+ *  which shadow the avr-libc ones: plain I/O registers are variables, the
+ *  ones with side effects go through sim.c, where the TWI, UART, timers and
+ *  the pins of the bit-banged I2C bus are modelled together with the
+ *  devices on the buses. This file is force included (-include) into every
+ *  translation unit of the host build.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE /* fopencookie, ptys */
+#endif
+
+#include <stdio.h>
+#include <stdint.h>
+
+/* avr-libc stdio extension, backed by fopencookie */
+FILE *fdevopen(int (*put)(char, FILE *), int (*get)(FILE *));
+
+/* avr-gcc builtin, spends simulated time */
+void sim_delay_cycles(const unsigned long n);
+#define __builtin_avr_delay_cycles(n) sim_delay_cycles(n)
+
+#endif /* _HAL_H */
@@ -0,0 +1,1722 @@
+/* Simulated ATmega328P peripherals and I2C devices, see sim.h */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <termios.h>
+
+#include <avr/io.h>
+#include <avr/eeprom.h>
+
+#include "sim.h"
+
+#define BIT(n) (1 << (n))
+
+/* Plain registers */
+volatile uint8_t SREG;
+volatile uint8_t PINB, DDRB, PORTB, PINC, DDRC, PORTC, PORTD;
+volatile uint8_t EICRA, EIMSK, EIFR, PCICR, PCIFR, PCMSK0, PCMSK1, PCMSK2;
+volatile uint8_t SMCR, MCUSR, MCUCR, PRR, WDTCSR;
+volatile uint8_t TCCR0A, TCCR0B, TCNT0, OCR0A, OCR0B, TIMSK0, TIFR0;
+volatile uint8_t TCCR2A, TCCR2B, OCR2A, OCR2B, TIMSK2, TIFR2;
+volatile uint8_t TCCR1A, TCCR1B, TCCR1C, TIMSK1;
+volatile uint16_t OCR1A, OCR1B, ICR1;
+volatile uint8_t UBRR0H, UBRR0L, UCSR0C;
+volatile uint8_t TWBR, TWSR, TWAR, TWDR, TWAMR;
+volatile uint8_t EECR, EEDR;
+volatile uint16_t EEAR;
+
+/* Vectors the firmware may or may not define */
+extern void INT0_vect(void) __attribute__((weak));
+extern void TIMER1_OVF_vect(void) __attribute__((weak));
+extern void TIMER2_COMPA_vect(void) __attribute__((weak));
+extern void TIMER0_COMPA_vect(void) __attribute__((weak));
+extern void USART_RX_vect(void) __attribute__((weak));
+extern void USART_UDRE_vect(void) __attribute__((weak));
+
+/* CPU time charged for every hooked register access */
+#define SIM_ACCESS_CYCLES 8
+/* A port access of the bit-banged bus, sbi, cbi or sbis */
+#define SIM_PORT_CYCLES 2
+
+static struct {
+	unsigned long frame_limit;
+	double seconds;
+	const char *pbm;
+	bool pbm_every;
+	bool realtime;
+	const char *eeprom;
+	unsigned long i2c_hang;
+	double vibration;
+	struct sim_event {
+		double t;
+		enum { SIM_STILL, SIM_MOVE, SIM_TAP, SIM_DROP } kind;
+	} events[32];
+	unsigned n_events;
+	struct timespec started;
+} cfg;
+
+/*
+ * Time and interrupts
+ */
+
+static uint64_t cycles = 0;
+/* Vectors running, more than one when an ISR has re-enabled interrupts */
+static unsigned isr_depth = 0;
+/* Vectors run, sim_sleep() waits for the next one */
+static unsigned long isr_count = 0;
+
+uint64_t sim_cycles(void)
+{
+	return cycles;
+}
+
+static void sim_advance(const uint64_t n)
+{
+	if (!cfg.realtime)
+		cycles += n;
+}
+
+static double elapsed_wall(void)
+{
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (t.tv_sec - cfg.started.tv_sec) +
+		(t.tv_nsec - cfg.started.tv_nsec) * 1e-9;
+}
+
+static void sim_sync_time(const unsigned cost)
+{
+	if (cfg.realtime)
+		cycles = elapsed_wall() * F_CPU;
+	else
+		cycles += cost;
+
+	if (cfg.seconds && cycles >= cfg.seconds * F_CPU)
+		exit(EXIT_SUCCESS);
+}
+
+static unsigned timer1_prescaler(void)
+{
+	static const unsigned prescalers[8] = { 0, 1, 8, 64, 256, 1024, 0, 0 };
+
+	return prescalers[TCCR1B & 7];
+}
+
+static uint64_t timer1_ticks(void)
+{
+	const unsigned p = timer1_prescaler();
+
+	return p? cycles / p: 0;
+}
+
+static uint64_t timer1_overflows = 0;
+
+static bool timer1_overflow_pending(void)
+{
+	return (timer1_ticks() >> 16) > timer1_overflows;
+}
+
+/* Timer0 and Timer2 in CTC mode only: the count wraps after OCRnA, which
+ * is taken as the compare match. A write to the count moves it, and with
+ * it the next match. Only TCNT2 is hooked, TCNT0 is never written. */
+struct ctc_timer {
+	volatile uint8_t *tccra, *tccrb, *ocra;
+	uint8_t ctc;                /* WGMn1 */
+	const unsigned *prescalers; /* by CSn2..0 */
+	bool running;
+	uint64_t base, matches;
+	uint8_t tcnt, tcnt_seen;
+};
+
+static const unsigned timer0_prescalers[8] = {
+	0, 1, 8, 64, 256, 1024, 0, 0
+};
+static const unsigned timer2_prescalers[8] = {
+	0, 1, 8, 32, 64, 128, 256, 1024
+};
+
+static struct ctc_timer timer0 = {
+	&TCCR0A, &TCCR0B, &OCR0A, BIT(WGM01), timer0_prescalers
+};
+static struct ctc_timer timer2 = {
+	&TCCR2A, &TCCR2B, &OCR2A, BIT(WGM21), timer2_prescalers
+};
+
+static unsigned ctc_prescaler(const struct ctc_timer *t)
+{
+	return *t->tccra & t->ctc? t->prescalers[*t->tccrb & 7]: 0;
+}
+
+static uint64_t ctc_period(const struct ctc_timer *t)
+{
+	return (uint64_t)ctc_prescaler(t) * (*t->ocra + 1);
+}
+
+static void ctc_sync(struct ctc_timer *t)
+{
+	const unsigned p = ctc_prescaler(t);
+
+	if (!p) {
+		t->running = false;
+		return;
+	}
+	if (!t->running || t->tcnt != t->tcnt_seen) {
+		/* Started, or the firmware has written the count */
+		t->base = cycles - (t->running? t->tcnt * p: 0);
+		t->matches = 0;
+		t->running = true;
+	}
+	t->tcnt = t->tcnt_seen = (cycles - t->base) / p % (*t->ocra + 1);
+}
+
+static bool ctc_match_pending(struct ctc_timer *t)
+{
+	ctc_sync(t);
+	return t->running && (cycles - t->base) / ctc_period(t) > t->matches;
+}
+
+/* Matches missed meanwhile set the flag only once */
+static void ctc_match_taken(struct ctc_timer *t)
+{
+	t->matches = (cycles - t->base) / ctc_period(t);
+}
+
+static void uart_poll(void);
+static bool uart_rx_ready(void);
+static bool uart_tx_ready(void);
+static void uart_rx_deliver(void);
+
+/* INT0: the level of PD2 and the flag its edges set as EICRA asks */
+static struct {
+	bool level, flag;
+} int0;
+
+static bool int0_pending(void)
+{
+	return EICRA & (BIT(ISC01) | BIT(ISC00))? int0.flag: !int0.level;
+}
+
+static void sim_dispatch(void)
+{
+	unsigned budget = 1024;
+
+	if (!(SREG & BIT(SREG_I)))
+		return;
+
+	isr_depth++;
+	SREG &= ~BIT(SREG_I);
+	while (budget--) {
+		if (int0_pending() && (EIMSK & BIT(INT0)) && INT0_vect) {
+			int0.flag = false;
+			INT0_vect();
+		} else if (timer1_overflow_pending() && (TIMSK1 & BIT(TOIE1)) &&
+				TIMER1_OVF_vect) {
+			timer1_overflows++;
+			TIMER1_OVF_vect();
+		} else if (ctc_match_pending(&timer2) &&
+				(TIMSK2 & BIT(OCIE2A)) && TIMER2_COMPA_vect) {
+			ctc_match_taken(&timer2);
+			TIMER2_COMPA_vect();
+		} else if (ctc_match_pending(&timer0) &&
+				(TIMSK0 & BIT(OCIE0A)) && TIMER0_COMPA_vect) {
+			ctc_match_taken(&timer0);
+			TIMER0_COMPA_vect();
+		} else if (uart_rx_ready() && USART_RX_vect) {
+			uart_rx_deliver();
+			USART_RX_vect();
+		} else if ((*sim_ucsr0b() & BIT(UDRIE0)) && uart_tx_ready() &&
+				USART_UDRE_vect) {
+			USART_UDRE_vect();
+		} else {
+			break;
+		}
+		isr_count++;
+	}
+	SREG |= BIT(SREG_I);
+	isr_depth--;
+}
+
+static void soft_bus_update(void);
+static void int0_update(void);
+
+static void sim_poll_at(const unsigned cost)
+{
+	sim_sync_time(cost);
+	uart_poll();
+	soft_bus_update();
+	int0_update();
+	sim_dispatch();
+}
+
+static void sim_poll(void)
+{
+	sim_poll_at(SIM_ACCESS_CYCLES);
+}
+
+/* Time passes in steps while the CPU waits, so that the interrupts and the
+ * UART go on meanwhile */
+#define SIM_SLEEP_CYCLES 64
+
+void sim_delay_cycles(const unsigned long n)
+{
+	unsigned long left = n;
+
+	for (; left > SIM_SLEEP_CYCLES; left -= SIM_SLEEP_CYCLES)
+		sim_poll_at(SIM_SLEEP_CYCLES);
+	sim_advance(left);
+}
+
+void sim_sleep(void)
+{
+	const unsigned long taken = isr_count;
+
+	/* Nothing would wake it up, the sleep instruction is a nop */
+	if (!(SMCR & BIT(SE)) || !(SREG & BIT(SREG_I)))
+		return;
+	while (isr_count == taken)
+		sim_poll_at(SIM_SLEEP_CYCLES);
+}
+
+void sim_cli(void)
+{
+	SREG &= ~BIT(SREG_I);
+}
+
+void sim_sei(void)
+{
+	SREG |= BIT(SREG_I);
+	sim_poll();
+}
+
+volatile uint16_t *sim_tcnt1(void)
+{
+	static volatile uint16_t tcnt1;
+
+	sim_poll();
+	tcnt1 = timer1_ticks();
+	return &tcnt1;
+}
+
+volatile uint8_t *sim_tcnt2(void)
+{
+	sim_poll();
+	ctc_sync(&timer2);
+	return &timer2.tcnt;
+}
+
+volatile uint8_t *sim_tifr1(void)
+{
+	static volatile uint8_t tifr1;
+
+	/* Writes (clearing flags) are ignored, TOV1 is derived */
+	sim_poll();
+	tifr1 = timer1_overflow_pending()? BIT(TOV1): 0;
+	return &tifr1;
+}
+
+/*
+ * USART0
+ */
+
+/* UDR0 holds the received byte with this tag in the upper half, anything
+ * else is a byte the firmware has just written */
+#define UDR_RX_TAG 0x5a00
+
+static volatile uint8_t ucsr0a, ucsr0b;
+static volatile uint16_t udr0 = UDR_RX_TAG;
+/* What a read of UDR0 returns, the written byte replaces it until the
+ * next access only */
+static uint16_t uart_rx_data = UDR_RX_TAG;
+/* The transmit buffer, -1 when empty, and when the byte in the shift
+ * register is out */
+static int uart_tx_data = -1;
+static uint64_t uart_tx_written = 0, uart_tx_end = 0;
+
+static int uart_out_fd = STDOUT_FILENO, uart_in_fd = STDIN_FILENO;
+static char uart_out_buf[4096];
+static size_t uart_out_len = 0;
+static uint8_t uart_in_buf[256];
+static size_t uart_in_len = 0, uart_in_pos = 0;
+static uint64_t uart_rx_last = 0;
+static unsigned uart_polls = 0;
+
+static void uart_flush(void)
+{
+	size_t done = 0;
+
+	while (done < uart_out_len) {
+		const ssize_t n = write(uart_out_fd, uart_out_buf + done,
+				uart_out_len - done);
+		if (n <= 0)
+			break;
+		done += n;
+	}
+	uart_out_len = 0;
+}
+
+static uint64_t uart_byte_cycles(void)
+{
+	const uint16_t ubrr = UBRR0H << 8 | UBRR0L;
+
+	return 10ULL * (ubrr + 1) * (ucsr0a & BIT(U2X0)? 8: 16);
+}
+
+/* A written byte moves to the shift register once that is empty and
+ * takes a frame time to go out, the transmit buffer is free again as soon
+ * as it has moved */
+static void uart_tx_update(void)
+{
+	if ((udr0 & 0xff00) != UDR_RX_TAG) {
+		uart_tx_data = udr0 & 0xff;
+		uart_tx_written = cycles;
+		udr0 = uart_rx_data;
+	}
+	if (uart_tx_data < 0 || cycles < uart_tx_end)
+		return;
+
+	uart_tx_end = (uart_tx_written > uart_tx_end? uart_tx_written:
+			uart_tx_end) + uart_byte_cycles();
+	if (ucsr0b & BIT(TXEN0)) {
+		uart_out_buf[uart_out_len++] = uart_tx_data;
+		if (uart_out_len == sizeof(uart_out_buf))
+			uart_flush();
+	}
+	uart_tx_data = -1;
+}
+
+static void uart_poll(void)
+{
+	uart_tx_update();
+
+	/* Don't make a syscall out of every register access */
+	if (++uart_polls % 4096)
+		return;
+	uart_flush();
+	if (uart_in_fd >= 0 && uart_in_pos == uart_in_len) {
+		const ssize_t n = read(uart_in_fd, uart_in_buf,
+				sizeof(uart_in_buf));
+
+		uart_in_pos = 0;
+		uart_in_len = n > 0? n: 0;
+		if (!n)
+			uart_in_fd = -1;
+	}
+}
+
+static bool uart_rx_ready(void)
+{
+	return (ucsr0b & BIT(RXEN0)) && (ucsr0b & BIT(RXCIE0)) &&
+		uart_in_pos < uart_in_len &&
+		cycles - uart_rx_last >= uart_byte_cycles();
+}
+
+static bool uart_tx_ready(void)
+{
+	return uart_tx_data < 0;
+}
+
+static void uart_rx_deliver(void)
+{
+	udr0 = uart_rx_data = UDR_RX_TAG | uart_in_buf[uart_in_pos++];
+	uart_rx_last = cycles;
+}
+
+volatile uint8_t *sim_ucsr0a(void)
+{
+	sim_poll();
+	ucsr0a = (ucsr0a & BIT(U2X0)) |
+		(uart_tx_ready()? BIT(UDRE0): 0) |
+		(uart_tx_ready() && cycles >= uart_tx_end? BIT(TXC0): 0) |
+		(uart_in_pos < uart_in_len? BIT(RXC0): 0);
+	return &ucsr0a;
+}
+
+volatile uint8_t *sim_ucsr0b(void)
+{
+	if (!isr_depth)
+		sim_poll();
+	return &ucsr0b;
+}
+
+volatile uint16_t *sim_udr0(void)
+{
+	sim_poll();
+	return &udr0;
+}
+
+struct fdev {
+	int (*put)(char, FILE *);
+	FILE *f;
+};
+
+static ssize_t fdev_write(void *cookie, const char *buf, size_t size)
+{
+	struct fdev *d = cookie;
+	size_t i;
+
+	for (i = 0; i < size; i++)
+		d->put(buf[i], d->f);
+	return size;
+}
+
+FILE *fdevopen(int (*put)(char, FILE *), int (*get)(FILE *))
+{
+	static const cookie_io_functions_t io = { .write = fdev_write };
+	struct fdev *d = calloc(1, sizeof(*d));
+
+	if (!d || !put)
+		return NULL;
+	d->put = put;
+	d->f = fopencookie(d, "w", io);
+	if (d->f)
+		setvbuf(d->f, NULL, _IONBF, 0);
+	return d->f;
+}
+
+/*
+ * TWI master
+ */
+
+/* Reserved TWCR bit, marks an operation as carried out. Any value written
+ * by the firmware has it clear. */
+#define TWCR_DONE BIT(1)
+
+#define SIM_MAX_DEVICES 8
+
+static volatile uint8_t twcr;
+static struct sim_device *devices[SIM_MAX_DEVICES];
+static unsigned n_devices = 0;
+
+static enum {
+	TWI_IDLE,
+	TWI_ADDRESS,
+	TWI_WRITE,
+	TWI_READ,
+	TWI_NACKED,
+	TWI_HUNG     /* a slave holds SDA low until the TWI is reset */
+} twi_state = TWI_IDLE;
+static struct sim_device *twi_dev = NULL;
+static unsigned long twi_ops;
+
+static void sim_attach(struct sim_device *d)
+{
+	if (n_devices < SIM_MAX_DEVICES)
+		devices[n_devices++] = d;
+}
+
+static uint64_t twi_bit_cycles(void)
+{
+	return 16 + 2ULL * TWBR * (1 << (2 * (TWSR & 3)));
+}
+
+static void twi_process(void)
+{
+	const uint8_t c = twcr;
+	uint8_t status = 0xf8;
+	unsigned i;
+
+	if (!(c & BIT(TWEN))) {
+		twcr = c | TWCR_DONE;
+		return;
+	}
+
+	if (twi_state == TWI_HUNG ||
+			(cfg.i2c_hang && ++twi_ops % cfg.i2c_hang == 0)) {
+		if (twi_dev && twi_dev->stop)
+			twi_dev->stop(twi_dev);
+		twi_dev = NULL;
+		twi_state = TWI_HUNG;
+		/* TWINT never comes */
+		twcr = (c & ~BIT(TWINT)) | TWCR_DONE;
+		return;
+	}
+
+	if (c & BIT(TWSTO)) {
+		if (twi_dev && twi_dev->stop)
+			twi_dev->stop(twi_dev);
+		twi_dev = NULL;
+		twi_state = TWI_IDLE;
+		sim_advance(twi_bit_cycles());
+		/* No TWINT after a STOP, TWSTO clears itself */
+		twcr = (c & ~(BIT(TWINT) | BIT(TWSTO))) | TWCR_DONE;
+		return;
+	}
+
+	if (c & BIT(TWSTA)) {
+		status = twi_state == TWI_IDLE? 0x08: 0x10;
+		twi_state = TWI_ADDRESS;
+		sim_advance(twi_bit_cycles());
+	} else {
+		switch (twi_state) {
+			case TWI_ADDRESS: {
+				const bool read = TWDR & 1;
+				struct sim_device *d = NULL;
+
+				for (i = 0; i < n_devices; i++)
+					if (devices[i]->address == TWDR >> 1)
+						d = devices[i];
+				sim_advance(9 * twi_bit_cycles());
+				if (twi_dev && twi_dev != d && twi_dev->stop)
+					twi_dev->stop(twi_dev);
+				twi_dev = d;
+				if (d) {
+					d->start(d, read);
+					status = read? 0x40: 0x18;
+					twi_state = read? TWI_READ: TWI_WRITE;
+				} else {
+					status = read? 0x48: 0x20;
+					twi_state = TWI_NACKED;
+				}
+				break;
+			}
+
+			case TWI_WRITE:
+				twi_dev->write(twi_dev, TWDR);
+				sim_advance(9 * twi_bit_cycles());
+				status = 0x28;
+				break;
+
+			case TWI_READ:
+				TWDR = twi_dev->read(twi_dev);
+				sim_advance(9 * twi_bit_cycles());
+				status = c & BIT(TWEA)? 0x50: 0x58;
+				break;
+
+			default:
+				break;
+		}
+	}
+
+	TWSR = status | (TWSR & 3);
+	twcr = c | BIT(TWINT) | TWCR_DONE;
+}
+
+volatile uint8_t *sim_twcr(void)
+{
+	sim_poll();
+	/* Disabling the TWI drops the transfer, and the bus clear that
+	 * follows is modelled as always working */
+	if (!(twcr & BIT(TWEN)) && twi_state != TWI_IDLE) {
+		if (twi_dev && twi_dev->stop)
+			twi_dev->stop(twi_dev);
+		twi_dev = NULL;
+		twi_state = TWI_IDLE;
+	}
+	if ((twcr & BIT(TWINT)) && !(twcr & TWCR_DONE))
+		twi_process();
+	return &twcr;
+}
+
+/*
+ * Bit-banged bus on PD6 (SDA) and PD7 (SCL), see i2c_soft.c
+ */
+
+#define SOFT_SDA BIT(PD6)
+#define SOFT_SCL BIT(PD7)
+
+/* PORTD is taken as low: a pin drives its line low when it is an output */
+static volatile uint8_t ddrd, pind;
+
+/* Every change of the lines is seen in order, as the master only changes
+ * one through DDRD and any access of it runs the decoder first. The slave
+ * changes SDA on the falling SCL edges. */
+static struct {
+	bool scl, sda;    /* as last seen */
+	enum {
+		SOFT_IDLE,
+		SOFT_ADDRESS,
+		SOFT_WRITE,
+		SOFT_READ,
+		SOFT_IGNORE   /* not addressed, or the master has NACKed */
+	} state;
+	uint8_t bits;     /* rising SCL edges of the byte, the 9th one ACKs */
+	uint8_t shift;    /* byte from the master */
+	uint8_t out;      /* byte to the master */
+	bool slave_low;   /* the slave pulls SDA down */
+	bool nacked;
+	struct sim_device *dev;
+} soft = { .scl = true, .sda = true };
+
+static void soft_stop_device(void)
+{
+	if (soft.dev && soft.dev->stop)
+		soft.dev->stop(soft.dev);
+	soft.dev = NULL;
+}
+
+static void soft_rise(const bool sda)
+{
+	if (soft.bits++ < 8) {
+		if (soft.state == SOFT_ADDRESS || soft.state == SOFT_WRITE)
+			soft.shift = soft.shift << 1 | sda;
+	} else if (soft.state == SOFT_READ) {
+		soft.nacked = sda;
+	}
+}
+
+/* The slave acknowledges a byte, lets go of SDA for the master's ACK, or
+ * puts out the next bit */
+static void soft_fall(void)
+{
+	unsigned i;
+
+	if (soft.bits == 8) {
+		soft.slave_low = false;
+		if (soft.state == SOFT_ADDRESS) {
+			const bool read = soft.shift & 1;
+			struct sim_device *d = NULL;
+
+			for (i = 0; i < n_devices; i++)
+				if (devices[i]->address == soft.shift >> 1)
+					d = devices[i];
+			if (soft.dev != d)
+				soft_stop_device();
+			soft.dev = d;
+			if (d) {
+				d->start(d, read);
+				soft.state = read? SOFT_READ: SOFT_WRITE;
+				soft.slave_low = true;
+			} else {
+				soft.state = SOFT_IGNORE;
+			}
+		} else if (soft.state == SOFT_WRITE) {
+			soft.dev->write(soft.dev, soft.shift);
+			soft.slave_low = true;
+		}
+	} else if (soft.bits == 9) {
+		soft.bits = 0;
+		soft.slave_low = false;
+		if (soft.state == SOFT_READ) {
+			if (soft.nacked) {
+				soft.state = SOFT_IGNORE;
+			} else {
+				soft.out = soft.dev->read(soft.dev);
+				soft.slave_low = !(soft.out & 0x80);
+			}
+		}
+	} else if (soft.state == SOFT_READ) {
+		soft.slave_low = !((soft.out << soft.bits) & 0x80);
+	}
+}
+
+static bool soft_sda(void)
+{
+	return !(ddrd & SOFT_SDA) && !soft.slave_low;
+}
+
+static void soft_bus_update(void)
+{
+	const bool scl = !(ddrd & SOFT_SCL);
+	const bool sda = soft_sda();
+
+	if (scl && soft.scl && sda != soft.sda) {
+		if (!sda) {
+			/* START, or a repeated one */
+			soft.state = SOFT_ADDRESS;
+			soft.bits = 0;
+		} else {
+			soft_stop_device();
+			soft.state = SOFT_IDLE;
+		}
+	} else if (scl && !soft.scl) {
+		soft_rise(sda);
+	} else if (!scl && soft.scl) {
+		soft_fall();
+	}
+	soft.scl = scl;
+	soft.sda = soft_sda();
+}
+
+volatile uint8_t *sim_ddrd(void)
+{
+	sim_poll_at(SIM_PORT_CYCLES);
+	return &ddrd;
+}
+
+volatile uint8_t *sim_pind(void)
+{
+	sim_poll_at(SIM_PORT_CYCLES);
+	pind = (pind & ~(SOFT_SDA | SOFT_SCL | BIT(PD2))) |
+		(soft.sda? SOFT_SDA: 0) | (soft.scl? SOFT_SCL: 0) |
+		(int0.level? BIT(PD2): 0);
+	return &pind;
+}
+
+/*
+ * Sensor data: synthetic motion or a recorded capture
+ */
+
+enum { SIM_ACC, SIM_GYRO, SIM_COMPASS, SIM_SENSORS };
+
+struct sim_sample {
+	uint64_t t_us;
+	int16_t v[3];
+};
+
+static struct {
+	struct sim_sample *s;
+	size_t n, cur;
+} capture[SIM_SENSORS];
+
+static void capture_load(const char *path)
+{
+	static const char *names[SIM_SENSORS] = { "acc", "gyro", "compass" };
+	FILE *f = fopen(path, "r");
+	char name[16];
+	unsigned long long t;
+	int x, y, z;
+	int i;
+
+	if (!f) {
+		perror(path);
+		exit(EXIT_FAILURE);
+	}
+	while (!feof(f)) {
+		if (fscanf(f, "%15[^,],%llu,%d,%d,%d\n",
+					name, &t, &x, &y, &z) != 5) {
+			/* Header or anything else */
+			if (fscanf(f, "%*[^\n]\n") == EOF)
+				break;
+			continue;
+		}
+		for (i = 0; i < SIM_SENSORS; i++) {
+			if (!strcmp(name, names[i])) {
+				struct sim_sample *s;
+
+				capture[i].s = realloc(capture[i].s,
+						++capture[i].n * sizeof(*s));
+				s = &capture[i].s[capture[i].n - 1];
+				s->t_us = t;
+				s->v[0] = x;
+				s->v[1] = y;
+				s->v[2] = z;
+			}
+		}
+	}
+	fclose(f);
+}
+
+/* Latest captured sample at the current time, relative to the first one */
+static bool capture_sample(const int sensor, int16_t v[3])
+{
+	typeof(capture[0]) *c = &capture[sensor];
+	uint64_t now;
+
+	if (!c->n)
+		return false;
+
+	now = c->s[0].t_us + cycles / (F_CPU / 1000000);
+	while (c->cur + 1 < c->n && c->s[c->cur + 1].t_us <= now)
+		c->cur++;
+	memcpy(v, c->s[c->cur].v, sizeof(c->s[0].v));
+	return true;
+}
+
+/* Roll and pitch swing, heading turns slowly. t in seconds */
+static void swing_at(const double t, double a[3], double w[3],
+		double *heading)
+{
+	const double f_roll = 0.25, f_pitch = 0.1;
+	const double roll = 0.5 * sin(2 * M_PI * f_roll * t);
+	const double pitch = 0.3 * sin(2 * M_PI * f_pitch * t);
+
+	/* Gravity in the sensor frame, in g */
+	a[0] = -sin(pitch);
+	a[1] = sin(roll) * cos(pitch);
+	a[2] = cos(roll) * cos(pitch);
+
+	/* Body rates, in deg/s */
+	w[0] = 0.5 * 2 * M_PI * f_roll * cos(2 * M_PI * f_roll * t) * 180 / M_PI;
+	w[1] = 0.3 * 2 * M_PI * f_pitch * cos(2 * M_PI * f_pitch * t) * 180 / M_PI;
+	w[2] = 10;
+
+	*heading = fmod(10 * t, 360) * M_PI / 180;
+}
+
+/* The swing with SIM_EVENTS and SIM_VIBRATION on top. t in cycles */
+static void motion_at(const uint64_t when, double a[3], double w[3],
+		double *heading)
+{
+	const double t = (double)when / F_CPU;
+	double still = -1;
+	unsigned i;
+
+	for (i = 0; i < cfg.n_events && cfg.events[i].t <= t; i++)
+		if (cfg.events[i].kind == SIM_STILL && still < 0)
+			still = cfg.events[i].t;
+		else if (cfg.events[i].kind == SIM_MOVE)
+			still = -1;
+
+	/* At rest: level, keeping the heading of the moment */
+	swing_at(still < 0? t: still, a, w, heading);
+	if (still >= 0) {
+		a[0] = a[1] = 0;
+		a[2] = 1;
+		w[0] = w[1] = w[2] = 0;
+	}
+
+	/* A machine shaking the board: its fundamental and third harmonic
+	 * along z, some of the fundamental along x */
+	if (cfg.vibration) {
+		const double f = 2 * M_PI * cfg.vibration * t;
+
+		a[0] += 0.1 * sin(f);
+		a[2] += 0.2 * sin(f) + 0.05 * sin(3 * f);
+	}
+
+	for (i = 0; i < cfg.n_events && cfg.events[i].t <= t; i++) {
+		const double since = t - cfg.events[i].t;
+
+		if (cfg.events[i].kind == SIM_TAP && since < 0.015)
+			a[2] += 4;
+		else if (cfg.events[i].kind == SIM_DROP && since < 0.3)
+			a[0] = a[1] = a[2] = 0;
+	}
+}
+
+/* "seconds:kind,..." in time order */
+static void events_load(const char *s)
+{
+	static const char *const kinds[] = { "still", "move", "tap", "drop" };
+
+	while (*s && cfg.n_events < sizeof(cfg.events) / sizeof(cfg.events[0])) {
+		struct sim_event *e = &cfg.events[cfg.n_events];
+		char *end;
+		unsigned k;
+
+		e->t = strtod(s, &end);
+		if (*end++ != ':')
+			break;
+		for (k = 0; k < sizeof(kinds) / sizeof(kinds[0]); k++)
+			if (!strncmp(end, kinds[k], strlen(kinds[k])))
+				break;
+		if (k == sizeof(kinds) / sizeof(kinds[0])) {
+			fprintf(stderr, "sim: unknown event %s\n", end);
+			break;
+		}
+		e->kind = k;
+		cfg.n_events++;
+		s = end + strlen(kinds[k]);
+		if (*s == ',')
+			s++;
+	}
+}
+
+static void motion(double a[3], double w[3], double *heading)
+{
+	motion_at(cycles, a, w, heading);
+}
+
+static int noise(void)
+{
+	static uint32_t seed = 12345;
+
+	seed = seed * 1103515245 + 12345;
+	return (int)((seed >> 16) % 5) - 2;
+}
+
+static int16_t clamp16(const double v)
+{
+	return v > INT16_MAX? INT16_MAX: v < INT16_MIN? INT16_MIN: lround(v);
+}
+
+/*
+ * Register file devices
+ */
+
+struct regdev {
+	struct sim_device dev;
+	uint8_t regs[64];
+	uint8_t ptr;
+	bool addressed;
+	bool autoinc;
+	/* Device specific behaviour */
+	void (*set_ptr)(struct regdev *r, const uint8_t c);
+	void (*next)(struct regdev *r);
+	void (*sample)(struct regdev *r);
+};
+
+static void regdev_start(struct sim_device *d, const bool read)
+{
+	struct regdev *r = (struct regdev *)d;
+
+	r->addressed = false;
+	if (read && r->sample)
+		r->sample(r);
+}
+
+static void regdev_write(struct sim_device *d, const uint8_t c)
+{
+	struct regdev *r = (struct regdev *)d;
+
+	if (!r->addressed) {
+		r->set_ptr(r, c);
+		r->addressed = true;
+		return;
+	}
+	r->regs[r->ptr] = c;
+	r->next(r);
+}
+
+static uint8_t regdev_read(struct sim_device *d)
+{
+	struct regdev *r = (struct regdev *)d;
+	const uint8_t c = r->regs[r->ptr];
+
+	r->next(r);
+	return c;
+}
+
+static void put_le(uint8_t *p, const int16_t v[3])
+{
+	int i;
+
+	for (i = 0; i < 3; i++) {
+		p[2 * i] = v[i] & 0xff;
+		p[2 * i + 1] = (uint16_t)v[i] >> 8;
+	}
+}
+
+/* ADXL345: register pointer always increments */
+static void adxl345_set_ptr(struct regdev *r, const uint8_t c)
+{
+	r->ptr = c & 0x3f;
+}
+
+/* Samples are taken at the ODR while measuring. They go through the
+ * motion engines, and into the 32 sample FIFO in stream mode. */
+static struct {
+	bool on, fifo;
+	uint64_t next;  /* cycles of the next sample */
+	int16_t v[32][3];
+	uint8_t head, count;
+	/* Motion engines, in cycles, 0 for none */
+	bool armed, act_armed, inact_armed, ff_seen;
+	int16_t act_ref[3], inact_ref[3];
+	uint64_t inact_since, ff_since, tap_since, tap_last;
+} adxl;
+
+/* 10 bits over the range unless FULL_RES */
+static double adxl345_lsb_per_g(const struct regdev *r)
+{
+	const uint8_t format = r->regs[0x31];
+
+	return format & BIT(3)? 256: 256 >> (format & 3);
+}
+
+static void adxl345_measure(struct regdev *r, const uint64_t when,
+		int16_t v[3])
+{
+	int i;
+
+	if (!capture_sample(SIM_ACC, v)) {
+		const double lsb_per_g = adxl345_lsb_per_g(r);
+		double a[3], w[3], h;
+
+		motion_at(when, a, w, &h);
+		for (i = 0; i < 3; i++)
+			v[i] = clamp16(a[i] * lsb_per_g + noise());
+	}
+	/* OFSx are 15.6 mg/LSB, added by the chip */
+	for (i = 0; i < 3; i++)
+		v[i] += (int8_t)r->regs[0x1e + i] * 4;
+}
+
+/* Activity and inactivity start from the sample they are armed with, in
+ * link mode each one arms the other, activity waiting for inactivity */
+static void adxl345_arm(struct regdev *r, const bool activity,
+		const uint64_t when, const int16_t v[3])
+{
+	const bool link = r->regs[0x2d] & BIT(5);
+
+	adxl.act_armed = activity || !link;
+	adxl.inact_armed = !activity || !link;
+	memcpy(adxl.act_ref, v, sizeof(adxl.act_ref));
+	memcpy(adxl.inact_ref, v, sizeof(adxl.inact_ref));
+	adxl.inact_since = when;
+}
+
+/* The engines on one sample, setting INT_SOURCE bits. Simplified: no
+ * sleep mode, and the tap axes aren't suppressed. */
+static void adxl345_detect(struct regdev *r, const uint64_t when,
+		const int16_t v[3])
+{
+	/* A threshold LSB is 62.5 mg */
+	const double thr = adxl345_lsb_per_g(r) / 16;
+	const uint8_t ctl = r->regs[0x27];
+	const uint64_t dur = r->regs[0x21] * (uint64_t)F_CPU * 625 / 1000000;
+	const uint64_t latent = r->regs[0x22] * (uint64_t)F_CPU / 800;
+	const uint64_t window = r->regs[0x23] * (uint64_t)F_CPU / 800;
+	bool tap = false, fall = true, active = false, still = true;
+	uint8_t src = 0;
+	int i;
+
+	if (!adxl.armed) {
+		adxl.armed = true;
+		adxl345_arm(r, false, when, v);
+	}
+	/* x, y, z in bits 2, 1, 0 of TAP_AXES and of either half of
+	 * ACT_INACT_CTL, whose top bits pick ac coupling */
+	for (i = 0; i < 3; i++) {
+		const int a = abs(v[i]);
+		const int act = abs(v[i] - (ctl & BIT(7)? adxl.act_ref[i]: 0));
+		const int inact = abs(v[i] - (ctl & BIT(3)? adxl.inact_ref[i]: 0));
+
+		if ((r->regs[0x2a] & BIT(2 - i)) && a > r->regs[0x1d] * thr)
+			tap = true;
+		if (a >= r->regs[0x28] * thr)
+			fall = false;
+		if ((ctl & BIT(6 - i)) && act > r->regs[0x24] * thr)
+			active = true;
+		if ((ctl & BIT(2 - i)) && inact > r->regs[0x25] * thr)
+			still = false;
+	}
+
+	/* A tap is over THRESH_TAP for DUR at most, a second one after
+	 * Latent and within Window makes a double tap */
+	if (tap && !adxl.tap_since) {
+		adxl.tap_since = when;
+	} else if (!tap && adxl.tap_since) {
+		if (when - adxl.tap_since <= dur) {
+			src |= BIT(6);
+			if (adxl.tap_last && when - adxl.tap_last > latent &&
+					when - adxl.tap_last <= latent + window) {
+				src |= BIT(5);
+				adxl.tap_last = 0;
+			} else {
+				adxl.tap_last = when;
+			}
+		}
+		adxl.tap_since = 0;
+	}
+
+	/* Free fall: all axes below THRESH_FF for TIME_FF in 5 ms, once */
+	if (!fall) {
+		adxl.ff_since = 0;
+		adxl.ff_seen = false;
+	} else if (!adxl.ff_since) {
+		adxl.ff_since = when;
+	} else if (!adxl.ff_seen &&
+			when - adxl.ff_since >= r->regs[0x29] * (uint64_t)F_CPU / 200) {
+		src |= BIT(2);
+		adxl.ff_seen = true;
+	}
+
+	if (adxl.act_armed && active) {
+		src |= BIT(4);
+		if (r->regs[0x2d] & BIT(5))
+			adxl345_arm(r, false, when, v);
+	}
+	/* Inactivity takes a new reference whenever it is exceeded */
+	if (adxl.inact_armed && !still) {
+		memcpy(adxl.inact_ref, v, sizeof(adxl.inact_ref));
+		adxl.inact_since = when;
+	} else if (adxl.inact_armed &&
+			when - adxl.inact_since >= r->regs[0x26] * (uint64_t)F_CPU) {
+		src |= BIT(3);
+		adxl345_arm(r, true, when, v);
+	}
+
+	r->regs[0x30] |= src & r->regs[0x2e];
+}
+
+/* Catches up with the samples taken since the last call */
+static void adxl345_step(struct regdev *r)
+{
+	/* BW_RATE: 3200 Hz at 0xf, halved by every step down */
+	const uint64_t period = ((uint64_t)F_CPU <<
+			(0x0f - (r->regs[0x2c] & 0x0f))) / 3200;
+	const bool stream = (r->regs[0x38] >> 6) == 2;
+	int16_t v[3];
+
+	if (!(r->regs[0x2d] & BIT(3))) {
+		adxl.on = false;
+		return;
+	}
+	if (!adxl.on) {
+		adxl.on = true;
+		adxl.armed = false;
+		adxl.count = 0;
+		adxl.next = cycles + period;
+	}
+	/* Starts empty when switched on */
+	if (stream != adxl.fifo) {
+		adxl.fifo = stream;
+		adxl.count = 0;
+	}
+	if (cycles > adxl.next + 32 * period)
+		adxl.next = cycles - 32 * period;
+
+	for (; adxl.next <= cycles; adxl.next += period) {
+		adxl345_measure(r, adxl.next, v);
+		adxl345_detect(r, adxl.next, v);
+		if (!stream)
+			continue;
+		/* Stream mode: a full FIFO drops its oldest sample */
+		if (adxl.count == 32) {
+			adxl.head = (adxl.head + 1) & 31;
+			adxl.count--;
+		}
+		memcpy(adxl.v[(adxl.head + adxl.count++) & 31], v, sizeof(v));
+	}
+
+	r->regs[0x39] = adxl.count; /* FIFO_STATUS: entries */
+	if (adxl.count)
+		put_le(&r->regs[0x32], adxl.v[adxl.head]);
+}
+
+/* With the FIFO on, reading DATAZ1 pops a sample. Reading INT_SOURCE
+ * clears the events. */
+static void adxl345_next(struct regdev *r)
+{
+	if (r->ptr == 0x30)
+		r->regs[0x30] &= ~0x7c;
+	if (r->ptr == 0x37 && adxl.fifo && adxl.count) {
+		adxl.head = (adxl.head + 1) & 31;
+		adxl.count--;
+		adxl345_step(r);
+	}
+	r->ptr = (r->ptr + 1) & 0x3f;
+}
+
+static void adxl345_sample(struct regdev *r)
+{
+	int16_t v[3];
+
+	adxl345_step(r);
+	if (!adxl.fifo) {
+		adxl345_measure(r, cycles, v);
+		put_le(&r->regs[0x32], v);
+	}
+	r->regs[0x30] |= BIT(7); /* DATA_READY */
+}
+
+static struct regdev adxl345 = {
+	.dev = { 0x53, regdev_start, regdev_write, regdev_read, NULL },
+	.set_ptr = adxl345_set_ptr,
+	.next = adxl345_next,
+	.sample = adxl345_sample,
+};
+
+/* INT1 of the ADXL345 on PD2: the events in INT_SOURCE that INT_ENABLE
+ * lets through and INT_MAP leaves on INT1, active low with INT_INVERT */
+static void int0_update(void)
+{
+	const struct regdev *r = &adxl345;
+	bool level;
+
+	adxl345_step(&adxl345);
+	level = (r->regs[0x30] & r->regs[0x2e] & ~r->regs[0x2f] & 0x7f) != 0;
+	if (r->regs[0x31] & BIT(5))
+		level = !level;
+
+	switch (EICRA & (BIT(ISC01) | BIT(ISC00))) {
+	case BIT(ISC00):
+		int0.flag |= level != int0.level;
+		break;
+	case BIT(ISC01):
+		int0.flag |= !level && int0.level;
+		break;
+	case BIT(ISC01) | BIT(ISC00):
+		int0.flag |= level && !int0.level;
+		break;
+	}
+	int0.level = level;
+}
+
+/* L3G4200D: the MSB of the sub-address enables auto-increment */
+static void l3g4200d_set_ptr(struct regdev *r, const uint8_t c)
+{
+	r->ptr = c & 0x3f;
+	r->autoinc = c & 0x80;
+}
+
+/* 32 sample FIFO, filled at the ODR in FIFO and stream mode */
+static struct {
+	int16_t v[32][3];
+	uint8_t head, count;
+	bool on, overrun;
+	uint64_t next;  /* cycles of the next sample */
+} l3g_fifo;
+
+static bool l3g4200d_fifo_on(struct regdev *r)
+{
+	return (r->regs[0x24] & BIT(6)) && (r->regs[0x2e] >> 5);
+}
+
+static void l3g4200d_measure(struct regdev *r, const uint64_t when,
+		int16_t v[3])
+{
+	static const double mdps_per_lsb[4] = { 8.75, 17.5, 70, 70 };
+	int i;
+
+	if (!capture_sample(SIM_GYRO, v)) {
+		const double s = mdps_per_lsb[(r->regs[0x23] >> 4) & 3] / 1000;
+		double a[3], w[3], h;
+
+		motion_at(when, a, w, &h);
+		for (i = 0; i < 3; i++)
+			v[i] = clamp16(w[i] / s + noise());
+	}
+}
+
+/* Catches the FIFO up with the samples taken since the last access */
+static void l3g4200d_fill(struct regdev *r)
+{
+	const uint64_t period = F_CPU / (100 << (r->regs[0x20] >> 6));
+	const bool stream = (r->regs[0x2e] >> 5) == 2;
+
+	if (!(r->regs[0x20] & BIT(3)) || !l3g4200d_fifo_on(r)) {
+		l3g_fifo.on = false;
+		return;
+	}
+	/* Starts empty when switched on */
+	if (!l3g_fifo.on) {
+		l3g_fifo.on = true;
+		l3g_fifo.count = 0;
+		l3g_fifo.overrun = false;
+		l3g_fifo.next = cycles + period;
+	}
+	/* Don't bother with more than a FIFO worth of history */
+	if (cycles > l3g_fifo.next + 32 * period)
+		l3g_fifo.next = cycles - 32 * period;
+
+	for (; l3g_fifo.next <= cycles; l3g_fifo.next += period) {
+		if (l3g_fifo.count == 32) {
+			l3g_fifo.overrun = true;
+			if (!stream)
+				continue;
+			l3g_fifo.head = (l3g_fifo.head + 1) & 31;
+			l3g_fifo.count--;
+		}
+		l3g4200d_measure(r, l3g_fifo.next,
+				l3g_fifo.v[(l3g_fifo.head + l3g_fifo.count++) & 31]);
+	}
+
+	/* FIFO_SRC: a full FIFO reads as 0 stored with OVRN */
+	r->regs[0x2f] = (l3g_fifo.count & 0x1f) |
+		(l3g_fifo.overrun? BIT(6): 0) | (l3g_fifo.count? 0: BIT(5)) |
+		(l3g_fifo.count > (r->regs[0x2e] & 0x1f)? BIT(7): 0);
+	if (l3g_fifo.count)
+		put_le(&r->regs[0x28], l3g_fifo.v[l3g_fifo.head]);
+}
+
+static void l3g4200d_pop(struct regdev *r)
+{
+	if (l3g_fifo.count) {
+		l3g_fifo.head = (l3g_fifo.head + 1) & 31;
+		l3g_fifo.count--;
+		l3g_fifo.overrun = false;
+	}
+	l3g4200d_fill(r);
+}
+
+/* With the FIFO on, reading past OUT_Z_H pops a sample and wraps to
+ * OUT_X_L, so one burst drains several samples */
+static void l3g4200d_next(struct regdev *r)
+{
+	if (r->ptr == 0x2d && l3g4200d_fifo_on(r)) {
+		l3g4200d_pop(r);
+		r->ptr = 0x28;
+		return;
+	}
+	if (r->autoinc)
+		r->ptr = (r->ptr + 1) & 0x3f;
+}
+
+static void l3g4200d_sample(struct regdev *r)
+{
+	int16_t v[3];
+
+	l3g4200d_fill(r);
+	if (l3g_fifo.on)
+		return;
+	l3g4200d_measure(r, cycles, v);
+	put_le(&r->regs[0x28], v);
+}
+
+static struct regdev l3g4200d = {
+	.dev = { 0x69, regdev_start, regdev_write, regdev_read, NULL },
+	.set_ptr = l3g4200d_set_ptr,
+	.next = l3g4200d_next,
+	.sample = l3g4200d_sample,
+};
+
+/* HMC5883L: the pointer wraps from the last data register back to the
+ * first one, and from the last register to 0 */
+static void hmc5883l_set_ptr(struct regdev *r, const uint8_t c)
+{
+	r->ptr = c < 13? c: 0;
+}
+
+static void hmc5883l_next(struct regdev *r)
+{
+	r->ptr = r->ptr == 8? 3: r->ptr == 12? 0: r->ptr + 1;
+}
+
+static void hmc5883l_sample(struct regdev *r)
+{
+	static const double lsb_per_gauss[8] = {
+		1370, 1090, 820, 660, 440, 390, 330, 230
+	};
+	const double gain = lsb_per_gauss[r->regs[1] >> 5];
+	int16_t v[3];
+
+	if (capture_sample(SIM_COMPASS, v)) {
+		/* Recorded as x, y, z */
+	} else if ((r->regs[0] & 3) == 1) {
+		/* Positive self-test bias field */
+		v[0] = v[1] = clamp16(1.16 * gain);
+		v[2] = clamp16(1.08 * gain);
+	} else {
+		/* 0.2 G north, 0.4 G down, seen from the tilted sensor */
+		double a[3], w[3], h, roll, pitch, x, y, z;
+
+		motion(a, w, &h);
+		pitch = asin(-a[0]);
+		roll = atan2(a[1], a[2]);
+		x = 0.2 * cos(h);
+		y = -0.2 * sin(h);
+		z = -0.4;
+		/* Into the sensor frame, pitch first */
+		x = x * cos(pitch) - z * sin(pitch);
+		z = 0.2 * cos(h) * sin(pitch) + z * cos(pitch);
+		v[0] = clamp16(x * gain + noise());
+		v[1] = clamp16((y * cos(roll) + z * sin(roll)) * gain + noise());
+		v[2] = clamp16((-y * sin(roll) + z * cos(roll)) * gain + noise());
+	}
+
+	/* Big-endian X, Z, Y */
+	r->regs[3] = (uint16_t)v[0] >> 8;
+	r->regs[4] = v[0] & 0xff;
+	r->regs[5] = (uint16_t)v[2] >> 8;
+	r->regs[6] = v[2] & 0xff;
+	r->regs[7] = (uint16_t)v[1] >> 8;
+	r->regs[8] = v[1] & 0xff;
+	r->regs[9] |= 1; /* RDY */
+}
+
+static struct regdev hmc5883l = {
+	.dev = { 0x1e, regdev_start, regdev_write, regdev_read, NULL },
+	.set_ptr = hmc5883l_set_ptr,
+	.next = hmc5883l_next,
+	.sample = hmc5883l_sample,
+};
+
+/*
+ * SSD1306 128x64 OLED
+ */
+
+static struct {
+	struct sim_device dev;
+	uint8_t ram[8][128];
+	bool control;      /* next byte is a control byte */
+	bool data;
+	bool single;       /* Co bit: a control byte follows every byte */
+	uint8_t cmd[3];
+	uint8_t cmd_len, cmd_need;
+	uint8_t mode;      /* 0 horizontal, 1 vertical, 2 page */
+	uint8_t col, col_start, col_end;
+	uint8_t page, page_start, page_end;
+	unsigned long frames;
+} ssd1306;
+
+static void ssd1306_dump(const char *path)
+{
+	FILE *f = fopen(path, "wb");
+	int x, y;
+
+	if (!f) {
+		perror(path);
+		return;
+	}
+	/* Lit pixels come out black */
+	fprintf(f, "P4\n128 64\n");
+	for (y = 0; y < 64; y++)
+		for (x = 0; x < 128; x += 8) {
+			uint8_t b = 0;
+			int i;
+
+			for (i = 0; i < 8; i++)
+				if (ssd1306.ram[y >> 3][x + i] & BIT(y & 7))
+					b |= 0x80 >> i;
+			fputc(b, f);
+		}
+	fclose(f);
+}
+
+static void ssd1306_frame(void)
+{
+	ssd1306.frames++;
+	if (cfg.pbm && cfg.pbm_every) {
+		char path[256];
+
+		snprintf(path, sizeof(path), cfg.pbm, (int)ssd1306.frames);
+		ssd1306_dump(path);
+	}
+	if (cfg.frame_limit && ssd1306.frames >= cfg.frame_limit)
+		exit(EXIT_SUCCESS);
+}
+
+static uint8_t ssd1306_args(const uint8_t cmd)
+{
+	switch (cmd) {
+		case 0x21:
+		case 0x22:
+			return 2;
+		case 0x20: case 0x81: case 0x8d: case 0xa8: case 0xd3:
+		case 0xd5: case 0xd9: case 0xda: case 0xdb:
+			return 1;
+		default:
+			return 0;
+	}
+}
+
+static void ssd1306_command(const uint8_t *c)
+{
+	switch (c[0]) {
+		case 0x20:
+			ssd1306.mode = c[1] & 3;
+			break;
+		case 0x21:
+			ssd1306.col = ssd1306.col_start = c[1] & 0x7f;
+			ssd1306.col_end = c[2] & 0x7f;
+			break;
+		case 0x22:
+			ssd1306.page = ssd1306.page_start = c[1] & 7;
+			ssd1306.page_end = c[2] & 7;
+			break;
+		default:
+			if (c[0] >= 0xb0 && c[0] <= 0xb7)
+				ssd1306.page = c[0] & 7;
+			else if (c[0] <= 0x0f)
+				ssd1306.col = (ssd1306.col & 0xf0) | c[0];
+			else if (c[0] <= 0x1f)
+				ssd1306.col = (ssd1306.col & 0x0f) | (c[0] & 7) << 4;
+			break;
+	}
+}
+
+static void ssd1306_data(const uint8_t c)
+{
+	ssd1306.ram[ssd1306.page][ssd1306.col] = c;
+
+	if (ssd1306.mode == 2) {
+		ssd1306.col = (ssd1306.col + 1) & 0x7f;
+		return;
+	}
+
+	if (ssd1306.mode == 0) {
+		if (ssd1306.col++ < ssd1306.col_end)
+			return;
+		ssd1306.col = ssd1306.col_start;
+		if (ssd1306.page++ < ssd1306.page_end)
+			return;
+		ssd1306.page = ssd1306.page_start;
+	} else {
+		if (ssd1306.page++ < ssd1306.page_end)
+			return;
+		ssd1306.page = ssd1306.page_start;
+		if (ssd1306.col++ < ssd1306.col_end)
+			return;
+		ssd1306.col = ssd1306.col_start;
+	}
+	/* Wrapped around the whole window */
+	ssd1306_frame();
+}
+
+static void ssd1306_start(struct sim_device *d, const bool read)
+{
+	ssd1306.control = true;
+}
+
+static void ssd1306_write(struct sim_device *d, const uint8_t c)
+{
+	if (ssd1306.control) {
+		ssd1306.single = c & 0x80;
+		ssd1306.data = c & 0x40;
+		ssd1306.control = false;
+		return;
+	}
+
+	if (ssd1306.data) {
+		ssd1306_data(c);
+	} else {
+		if (!ssd1306.cmd_len)
+			ssd1306.cmd_need = ssd1306_args(c);
+		ssd1306.cmd[ssd1306.cmd_len++] = c;
+		if (ssd1306.cmd_len > ssd1306.cmd_need) {
+			ssd1306_command(ssd1306.cmd);
+			ssd1306.cmd_len = 0;
+		}
+	}
+	ssd1306.control = ssd1306.single;
+}
+
+static uint8_t ssd1306_read(struct sim_device *d)
+{
+	return 0;
+}
+
+/*
+ * EEPROM, erased on every run unless backed by a file
+ */
+
+/* An erase and write cycle takes 3.4 ms */
+#define EEPROM_WRITE_CYCLES (F_CPU / 1000000 * 3400)
+
+static uint8_t eeprom[E2END + 1];
+
+static void eeprom_load(void)
+{
+	FILE *f;
+
+	memset(eeprom, 0xff, sizeof(eeprom));
+	if (!cfg.eeprom || !(f = fopen(cfg.eeprom, "rb")))
+		return;
+	if (fread(eeprom, 1, sizeof(eeprom), f) != sizeof(eeprom))
+		fprintf(stderr, "sim: %s is short, rest erased\n", cfg.eeprom);
+	fclose(f);
+}
+
+static void eeprom_store(void)
+{
+	FILE *f;
+
+	if (!cfg.eeprom)
+		return;
+	if (!(f = fopen(cfg.eeprom, "wb")) ||
+			fwrite(eeprom, 1, sizeof(eeprom), f) != sizeof(eeprom))
+		perror(cfg.eeprom);
+	if (f)
+		fclose(f);
+}
+
+uint8_t eeprom_read_byte(const uint8_t *p)
+{
+	sim_advance(4);
+	return eeprom[(uintptr_t)p & E2END];
+}
+
+void eeprom_read_block(void *dst, const void *src, size_t n)
+{
+	const uint8_t *p = src;
+	uint8_t *d = dst;
+
+	while (n--)
+		*d++ = eeprom_read_byte(p++);
+}
+
+void eeprom_update_block(const void *src, void *dst, size_t n)
+{
+	const uint8_t *s = src;
+	uintptr_t addr = (uintptr_t)dst;
+	bool changed = false;
+
+	for (; n--; s++, addr++) {
+		uint8_t *e = &eeprom[addr & E2END];
+
+		if (*e == *s)
+			continue;
+		*e = *s;
+		changed = true;
+		sim_advance(EEPROM_WRITE_CYCLES);
+	}
+	if (changed)
+		eeprom_store();
+}
+
+/*
+ * Setup
+ */
+
+static void sim_exit(void)
+{
+	const double t = (double)cycles / F_CPU;
+	const double wall = elapsed_wall();
+
+	uart_flush();
+	if (cfg.pbm && !cfg.pbm_every)
+		ssd1306_dump(cfg.pbm);
+	fprintf(stderr, "sim: %lu frames in %.3f s simulated, %.3f s real "
+			"(%.0f frames/s)\n", ssd1306.frames, t, wall,
+			wall > 0? ssd1306.frames / wall: 0);
+}
+
+static void sim_setup_pty(void)
+{
+	const int fd = posix_openpt(O_RDWR | O_NOCTTY);
+	struct termios t;
+
+	if (fd < 0 || grantpt(fd) || unlockpt(fd) || tcgetattr(fd, &t)) {
+		perror("pty");
+		exit(EXIT_FAILURE);
+	}
+	/* A serial line, no echo of our own output back to us */
+	cfmakeraw(&t);
+	tcsetattr(fd, TCSANOW, &t);
+	fprintf(stderr, "sim: UART on %s\n", ptsname(fd));
+	uart_out_fd = uart_in_fd = fd;
+}
+
+__attribute__((constructor))
+static void sim_setup(void)
+{
+	const char *s;
+
+	clock_gettime(CLOCK_MONOTONIC, &cfg.started);
+	if ((s = getenv("SIM_FRAMES")))
+		cfg.frame_limit = strtoul(s, NULL, 0);
+	if ((s = getenv("SIM_SECONDS")))
+		cfg.seconds = strtod(s, NULL);
+	if ((s = getenv("SIM_PBM"))) {
+		cfg.pbm = s;
+		cfg.pbm_every = strchr(s, '%');
+	}
+	if ((s = getenv("SIM_SENSORS")))
+		capture_load(s);
+	cfg.realtime = (s = getenv("SIM_REALTIME")) && atoi(s);
+	cfg.eeprom = getenv("SIM_EEPROM");
+	if ((s = getenv("SIM_I2C_HANG")))
+		cfg.i2c_hang = strtoul(s, NULL, 0);
+	if ((s = getenv("SIM_VIBRATION")))
+		cfg.vibration = strtod(s, NULL);
+	if ((s = getenv("SIM_EVENTS")))
+		events_load(s);
+	eeprom_load();
+	if ((s = getenv("SIM_PTY")) && atoi(s))
+		sim_setup_pty();
+	fcntl(uart_in_fd, F_SETFL, fcntl(uart_in_fd, F_GETFL) | O_NONBLOCK);
+
+	ssd1306.dev = (struct sim_device){
+		0x3c, ssd1306_start, ssd1306_write, ssd1306_read, NULL
+	};
+	ssd1306.col_end = 127;
+	ssd1306.page_end = 7;
+	ssd1306.mode = 2;
+
+	adxl345.regs[0x00] = 0xe5; /* DEVID */
+	adxl345.regs[0x2c] = 0x0a; /* BW_RATE */
+	l3g4200d.regs[0x0f] = 0xd3; /* WHO_AM_I */
+	l3g4200d.regs[0x20] = 0x07; /* CTRL_REG1 */
+	hmc5883l.regs[0] = 0x10;
+	hmc5883l.regs[1] = 0x20;
+	hmc5883l.regs[2] = 0x01;
+	hmc5883l.regs[10] = 'H';
+	hmc5883l.regs[11] = '4';
+	hmc5883l.regs[12] = '3';
+
+	sim_attach(&ssd1306.dev);
+	sim_attach(&adxl345.dev);
+	sim_attach(&l3g4200d.dev);
+	sim_attach(&hmc5883l.dev);
+
+	atexit(sim_exit);
+}
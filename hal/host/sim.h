@@ -0,0 +1,73 @@
+#ifndef _SIM_H
+#define _SIM_H
+
+/** Simulated peripherals of the host HAL.
+ *
+ *  Registers with side effects are accessed through these hooks, which
+ *  return the register storage after bringing the model up to date. As a
+ *  hook can't see whether the access is a read or a write, writes take
+ *  effect lazily at the next hooked access, the same way the firmware
+ *  waits for the hardware anyway (TWINT, UDRE0).
+ *
+ *  Every device sits on the TWI and on the bit-banged bus of i2c_soft.h
+ *  alike, where a decoder follows the pins and answers as a slave. INT1
+ *  of the ADXL345 drives PD2, INT0.
+ *
+ *  Configuration comes from the environment:
+ *  SIM_FRAMES=n      exit after n complete display frames
+ *  SIM_SECONDS=s     exit after s seconds of simulated time
+ *  SIM_PBM=file      dump the display RAM there on exit; a printf pattern
+ *                    with %d dumps every frame
+ *  SIM_SENSORS=file  play raw samples from a CSV capture as written by
+ *                    tools/telemetry_decode instead of synthetic motion
+ *  SIM_PTY=1         UART on a pseudo terminal instead of stdin/stdout
+ *  SIM_EEPROM=file   EEPROM contents, loaded at start and written back on
+ *                    every change; erased otherwise
+ *  SIM_I2C_HANG=n    every n-th TWI operation hangs the bus until the TWI
+ *                    is disabled, as after a bus clear
+ *  SIM_VIBRATION=hz  the board shakes at that frequency on top of the
+ *                    synthetic motion, with a third harmonic
+ *  SIM_EVENTS=list   scripted motion, "seconds:event" in time order and
+ *                    separated by commas: "still" lies level until "move",
+ *                    "tap" is a 4 g knock on z, "drop" 300 ms of free fall
+ *  SIM_REALTIME=1    Timer1 follows the wall clock; by default simulated
+ *                    time only advances with bus traffic and register
+ *                    accesses, which makes runs reproducible
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+volatile uint16_t *sim_tcnt1(void);
+volatile uint8_t *sim_tifr1(void);
+volatile uint8_t *sim_tcnt2(void);
+volatile uint8_t *sim_ucsr0a(void);
+volatile uint8_t *sim_ucsr0b(void);
+volatile uint16_t *sim_udr0(void);
+volatile uint8_t *sim_twcr(void);
+volatile uint8_t *sim_ddrd(void);
+volatile uint8_t *sim_pind(void);
+
+/** Busy wait, __builtin_avr_delay_cycles() */
+void sim_delay_cycles(const unsigned long n);
+
+/** sleep_cpu(), with SE set and interrupts on */
+void sim_sleep(void);
+
+void sim_cli(void);
+void sim_sei(void);
+
+/** A slave on the simulated buses */
+struct sim_device {
+	uint8_t address;
+	/** SLA has been acknowledged, also called on a repeated START */
+	void (*start)(struct sim_device *d, const bool read);
+	void (*write)(struct sim_device *d, const uint8_t c);
+	uint8_t (*read)(struct sim_device *d);
+	void (*stop)(struct sim_device *d);
+};
+
+/** @return simulated time in CPU cycles */
+uint64_t sim_cycles(void);
+
+#endif /* _SIM_H */
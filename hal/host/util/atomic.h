@@ -0,0 +1,55 @@
+#ifndef _HAL_UTIL_ATOMIC_H
+#define _HAL_UTIL_ATOMIC_H
+
+/* Same scheme as avr-libc: the saved SREG is restored by a cleanup
+ * handler when the block is left, whichever way that happens */
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+static inline uint8_t __hal_cli_ret(void)
+{
+	cli();
+	return 1;
+}
+
+static inline uint8_t __hal_sei_ret(void)
+{
+	sei();
+	return 1;
+}
+
+static inline void __hal_restore_sreg(const uint8_t *sreg)
+{
+	if (*sreg & _BV(SREG_I))
+		sei();
+	else
+		cli();
+}
+
+static inline void __hal_force_on(const uint8_t *sreg)
+{
+	sei();
+	(void)sreg;
+}
+
+static inline void __hal_force_off(const uint8_t *sreg)
+{
+	cli();
+	(void)sreg;
+}
+
+#define ATOMIC_BLOCK(type) \
+	for (type, __todo = __hal_cli_ret(); __todo; __todo = 0)
+#define NONATOMIC_BLOCK(type) \
+	for (type, __todo = __hal_sei_ret(); __todo; __todo = 0)
+
+#define ATOMIC_RESTORESTATE \
+	uint8_t sreg_save __attribute__((__cleanup__(__hal_restore_sreg))) = SREG
+#define ATOMIC_FORCEON \
+	uint8_t sreg_save __attribute__((__cleanup__(__hal_force_on))) = 0
+#define NONATOMIC_RESTORESTATE ATOMIC_RESTORESTATE
+#define NONATOMIC_FORCEOFF \
+	uint8_t sreg_save __attribute__((__cleanup__(__hal_force_off))) = 0
+
+#endif /* _HAL_UTIL_ATOMIC_H */
@@ -6,7 +6,11 @@
 #include <avr/pgmspace.h>
 
 #include "i2c.h"
+#include "i2c_soft.h"
 #include "uart.h"
+#include "perf.h"
+#include "i2c_trace.h"
+#include "clock.h"
 
 enum TWI_STATUS {
 	TWI_M_START = 0x08,
@@ -23,10 +27,15 @@ enum TWI_STATUS {
 	TWI_M_SLAR_ACK = 0x40,
 	TWI_M_SLAR_NACK = 0x48,
 	TWI_M_RDATA_ACK = 0x50,
-	TWI_M_RDATA_NACK = 0x58
+	TWI_M_RDATA_NACK = 0x58,
+
+	/* TWINT is low, what TWSR reads while a step is in progress */
+	TWI_NO_STATE = 0xf8
 };
 
-#define I2C_DEBUG
+/* Where the timeout goes among the status strings */
+#define TWI_TIMEOUT_INDEX ((TWI_M_RDATA_NACK >> 3) + 1)
+
 #define I2C_STR_ERRORS
 
 #ifdef I2C_STR_ERRORS
@@ -43,21 +52,23 @@ static const char twi_error_strings[][44] PROGMEM = {
 	[ TWI_M_SLAR_NACK >> 3]        = "SLA+R has been transmitted, got NACK",
 	[ TWI_M_RDATA_ACK >> 3]        = "Data has been received, sent ACK",
 	[ TWI_M_RDATA_NACK >> 3]       = "Data has been received, sent NACK",
+	[ TWI_TIMEOUT_INDEX ]          = "Timeout, the bus has been cleared",
 };
-static const char *i2c_last_error;
+static const char *i2c_last_error, *i2c_failed;
 static inline void i2c_dump_err()
 {
-	printb("Error: %S\r\n", i2c_last_error);
+	printb("Error: %" PRIpgm "\r\n", i2c_failed);
 }
 static inline void i2c_remember_err(const uint8_t twsr)
 {
-	i2c_last_error = twi_error_strings[twsr >> 3];
+	i2c_last_error = twi_error_strings[twsr == TWI_NO_STATE?
+		TWI_TIMEOUT_INDEX: twsr >> 3];
 }
 #else
-static uint8_t i2c_last_error;
+static uint8_t i2c_last_error, i2c_failed;
 static inline void i2c_dump_err()
 {
-	printb("Error: %#02hhx\r\n", i2c_last_error);
+	printb("Error: %#02hhx\r\n", i2c_failed);
 }
 static inline void i2c_remember_err(const uint8_t twsr)
 {
@@ -70,15 +81,17 @@ static int i2c_check_status()
 	uint8_t twsr = TWSR;
 	enum TWI_ERROR_STATUS err = TWI_OK;
 
+	i2c_trace_status(twsr);
+
 	switch (twsr) {
 		case TWI_M_SLAW_NACK:
 		case TWI_M_SLAR_NACK:
 		case TWI_M_WDATA_NACK:
-		case TWI_M_START_REPEAT:
 			err = TWI_ERROR;
 			break;
 
 		case TWI_M_START:
+		case TWI_M_START_REPEAT:
 		case TWI_M_SLAW_ACK:
 		case TWI_M_SLAR_ACK:
 		case TWI_M_WDATA_ACK:
@@ -101,9 +114,42 @@ static int i2c_check_status()
 	return err;
 }
 
+/* A step is a byte at most, 9 SCL periods: 290 us at 31 kHz. Much more
+ * than that, allowing for clock stretching, means a hung bus */
+#define I2C_TIMEOUT_US 1000
+
+#define I2C_SDA _BV(PC4)
+#define I2C_SCL _BV(PC5)
+
+#define I2C_STATS_DEVICES 4
+
+struct i2c_stats {
+	uint8_t address;
+	struct i2c_counts c;
+};
+
+static struct i2c_stats i2c_stats[I2C_STATS_DEVICES];
+static uint8_t i2c_retries = 2;
+/* A transaction is in progress, see i2c_busy() */
+static volatile bool i2c_owned = false;
+/* A transaction has failed since the last i2c_flush_errors() */
+static volatile bool i2c_error_pending = false;
+/* Devices on the bit-banged bus, a bit per address */
+static uint8_t i2c_soft_map[128 / 8];
+
 static int i2c_wait()
 {
-	while (!(TWCR & _BV(TWINT)));
+	const uint16_t start = clock_ticks16();
+
+	while (!(TWCR & _BV(TWINT)))
+		if ((uint16_t)(clock_ticks16() - start) >
+				I2C_TIMEOUT_US * CLOCK_TICKS_PER_US) {
+			PERF_STOP16(i2c_wait, start);
+			i2c_trace_status(TWI_NO_STATE);
+			i2c_remember_err(TWI_NO_STATE);
+			return TWI_TIMEOUT;
+		}
+	PERF_STOP16(i2c_wait, start);
 	return i2c_check_status();
 }
 
@@ -113,6 +159,7 @@ static inline int i2c_start(const uint8_t address, const bool read)
 {
 	enum TWI_ERROR_STATUS err = TWI_OK;
 
+	i2c_trace_start((address << 1) | read);
 	TWCR = (1 << TWSTA) | I2C_TX;
 	err = i2c_wait();
 
@@ -130,77 +177,235 @@ static inline void i2c_stop()
 	TWCR = I2C_TX | (1 << TWSTO);
 }
 
+/* Half an SCL period at 100 kHz */
+static void i2c_bit_delay()
+{
+	const uint16_t start = clock_ticks16();
+
+	while ((uint16_t)(clock_ticks16() - start) < 5 * CLOCK_TICKS_PER_US);
+}
+
+/* Bus clear: with the TWI off, clocks SCL by hand until the slave holding
+ * SDA low has shifted out the rest of its byte, then sends a STOP, 105 us
+ * at most. Lines are open drain, low when driven and pulled up when
+ * released. */
+static void i2c_bus_clear()
+{
+	uint8_t i;
+
+	TWCR = 0;
+	PORTC &= ~(I2C_SDA | I2C_SCL);
+	DDRC &= ~(I2C_SDA | I2C_SCL);
+	for (i = 0; i < 9 && !(PINC & I2C_SDA); i++) {
+		DDRC |= I2C_SCL;
+		i2c_bit_delay();
+		DDRC &= ~I2C_SCL;
+		i2c_bit_delay();
+	}
 
+	/* STOP: SDA rises while SCL is high */
+	DDRC |= I2C_SCL;
+	DDRC |= I2C_SDA;
+	i2c_bit_delay();
+	DDRC &= ~I2C_SCL;
+	i2c_bit_delay();
+	DDRC &= ~I2C_SDA;
+	i2c_bit_delay();
+
+	TWCR = 1 << TWEN;
+}
 
 void init_i2c() {
-	TWBR = (F_CPU / 100000UL - 16) / 2;
+	i2c_set_clock(100);
 	TWSR = 0;
 	TWCR = 1 << TWEN;
+	init_i2c_soft();
+}
+
+void i2c_set_clock(const uint16_t khz)
+{
+	/* No prescaler: SCL = F_CPU / (16 + 2 * TWBR) */
+	TWBR = (F_CPU / 1000UL / khz - 16) / 2;
 }
 
-#undef I2C_DEBUG
+void i2c_set_retries(const uint16_t n)
+{
+	i2c_retries = n;
+}
 
-void i2c_send(uint8_t address, const size_t N, const uint8_t bytes[N])
+/* The last slot takes whatever doesn't fit */
+static struct i2c_stats *i2c_stats_for(const uint8_t address)
 {
-	size_t i = 0;
-	enum TWI_ERROR_STATUS err = TWI_OK;
+	struct i2c_stats *s = i2c_stats;
 
-#ifdef I2C_DEBUG
-	printb("Sending %u: ", N);
-	for (i = 0; (i < 4) && (i < N); i++)
-		printb("%02hhx", bytes[i]);
-	printb("\r\n%s\r\n", i < N? "...": "");
-#endif /* I2C_DEBUG */
+	while (s < &i2c_stats[I2C_STATS_DEVICES - 1] && s->address &&
+			s->address != address)
+		s++;
+	s->address = address;
+	return s;
+}
 
-	err = i2c_start(address, false);
-	if (!err)
-		for (i = 0; i < N; i++) {
-			TWDR = bytes[i];
-			TWCR = I2C_TX;
-			err = i2c_wait();
-			if (err)
-				break;
-		}
+static bool i2c_on_soft(const uint8_t address)
+{
+	return i2c_soft_map[address >> 3] & _BV(address & 7);
+}
 
-	i2c_stop();
-	if (err)
-		i2c_dump_err();
+void i2c_set_soft(const uint8_t address, const bool soft)
+{
+	/* Nothing of the device still in flight on the old bus */
+	i2c_soft_flush();
+	if (soft)
+		i2c_soft_map[address >> 3] |= _BV(address & 7);
+	else
+		i2c_soft_map[address >> 3] &= ~_BV(address & 7);
 }
 
-#define I2C_DEBUG
-uint8_t i2c_receive(uint8_t address, const uint8_t N, uint8_t bytes[N])
+bool i2c_busy(const uint8_t address)
+{
+	return i2c_on_soft(address)? i2c_soft_busy(): i2c_owned;
+}
+
+void i2c_flush_errors(void)
+{
+	if (!i2c_error_pending)
+		return;
+	i2c_error_pending = false;
+	i2c_dump_err();
+}
+
+void i2c_report(void)
+{
+	uint8_t i;
+
+	for (i = 0; i < I2C_STATS_DEVICES && i2c_stats[i].address; i++)
+		printb("i2c %#02x: %u errors, %u retries, %u timeouts\r\n",
+				i2c_stats[i].address, i2c_stats[i].c.errors,
+				i2c_stats[i].c.retries, i2c_stats[i].c.timeouts);
+}
+
+/* Sends N bytes after SLA+W, stops at the first NACK */
+static int i2c_write_bytes(const size_t N, const uint8_t bytes[N], size_t *n)
 {
-	size_t n = 0;
 	enum TWI_ERROR_STATUS err = TWI_OK;
 
-#ifdef I2C_DEBUG
-	printb("I2C[%#hhx]: ", N);
-#endif /* I2C_DEBUG */
-	err = i2c_start(address, true);
+	for (; *n < N; (*n)++) {
+		TWDR = bytes[*n];
+		TWCR = I2C_TX;
+		err = i2c_wait();
+		if (err)
+			break;
+	}
+
+	return err;
+}
+
+/* Reads N bytes after SLA+R, NACKing the last one */
+static int i2c_read_bytes(const size_t N, uint8_t bytes[N], size_t *n)
+{
+	enum TWI_ERROR_STATUS err = TWI_OK;
 
-	while (!err && n < N) {
-		if (n < N-1)
+	for (; *n < N; (*n)++) {
+		if (*n < N-1)
 			TWCR = I2C_TX | 1 << TWEA;
 		else
 			TWCR = I2C_TX;
 		err = i2c_wait();
-		if (!err) {
-			bytes[n] = TWDR;
-#ifdef I2C_DEBUG
-			printb("%02hhx", bytes[n]);
-#endif /* I2C_DEBUG */
-		}
-		n++;
+		if (err)
+			break;
+		bytes[*n] = TWDR;
 	}
 
-	i2c_stop();
-	if (err)
-		i2c_dump_err();
+	return err;
+}
+
+/* One attempt: the register address if reg is not negative, then N bytes
+ * written, or read after a repeated START */
+static int i2c_attempt(const uint8_t address, const int16_t reg,
+		const bool read, const size_t N, uint8_t bytes[N], size_t *n)
+{
+	enum TWI_ERROR_STATUS err = TWI_OK;
+
+	*n = 0;
+	err = i2c_start(address, read && reg < 0);
+	if (!err && reg >= 0) {
+		TWDR = reg;
+		TWCR = I2C_TX;
+		err = i2c_wait();
+		/* The bus is never released in between */
+		if (!err && read)
+			err = i2c_start(address, true);
+	}
+	if (!err)
+		err = read? i2c_read_bytes(N, bytes, n):
+			i2c_write_bytes(N, bytes, n);
+
+	return err;
+}
+
+/* Repeats failed attempts, a timed out one after a bus clear. Each step
+ * is bounded, and so is the whole transaction. The error is only noted
+ * here, the transaction may run in an ISR while the main loop prints.
+ * A device on the bit-banged bus goes there instead, which retries and
+ * clears its bus the same way. */
+static size_t i2c_transfer(const uint8_t address, const int16_t reg,
+		const bool read, const size_t N, uint8_t bytes[N])
+{
+	struct i2c_stats *s;
+	enum TWI_ERROR_STATUS err = TWI_OK;
+	uint8_t attempt = 0;
+	size_t n;
+
+	s = i2c_stats_for(address);
+	if (i2c_on_soft(address)) {
+		n = i2c_soft_transfer(address, reg, read, N, bytes, i2c_retries,
+				&s->c);
+		PERF_I2C(address, n + (reg >= 0));
+		return n;
+	}
 
-#ifdef I2C_DEBUG
-	printb("\r\n");
-#endif /* I2C_DEBUG */
+	i2c_owned = true;
+	for (;;) {
+		err = i2c_attempt(address, reg, read, N, bytes, &n);
+		if (err == TWI_TIMEOUT) {
+			s->c.timeouts++;
+			i2c_bus_clear();
+		} else
+			i2c_stop();
+		i2c_trace_stop(err);
+		if (!err)
+			break;
+		if (attempt++ == i2c_retries) {
+			s->c.errors++;
+			i2c_failed = i2c_last_error;
+			i2c_error_pending = true;
+			break;
+		}
+		s->c.retries++;
+	}
+	PERF_I2C(address, n + (reg >= 0));
+	i2c_owned = false;
 
 	return n;
 }
 
+void i2c_send(uint8_t address, const size_t N, const uint8_t bytes[N])
+{
+	i2c_transfer(address, -1, false, N, (uint8_t *)bytes);
+}
+
+void i2c_write_regs(uint8_t address, const uint8_t reg, const size_t N,
+		const uint8_t bytes[N])
+{
+	i2c_transfer(address, reg, false, N, (uint8_t *)bytes);
+}
+
+uint8_t i2c_receive(uint8_t address, const uint8_t N, uint8_t bytes[N])
+{
+	return i2c_transfer(address, -1, true, N, bytes);
+}
+
+uint8_t i2c_read_regs(uint8_t address, const uint8_t reg, const uint8_t N,
+		uint8_t bytes[N])
+{
+	return i2c_transfer(address, reg, true, N, bytes);
+}
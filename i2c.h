@@ -1,17 +1,50 @@
 #ifndef _I2C_H
 #define _I2C_H
 
+#include <stddef.h>
 #include <stdint.h>
+#include <stdbool.h>
 
 enum TWI_ERROR_STATUS {
 	TWI_OK,
 	TWI_ERROR,
 	TWI_FATAL,
-	TWI_UNKNOWN
+	TWI_UNKNOWN,
+	TWI_TIMEOUT
 };
 
 void init_i2c();
+/** Sets the SCL frequency, 31 to 400 kHz */
+void i2c_set_clock(const uint16_t khz);
+/** Attempts repeated after a NACK, a lost arbitration or a timeout. Every
+ *  TWI step times out after 1 ms, and a timeout clears the bus in 105 us
+ *  at most. An attempt may take all three on top of its normal time, so a
+ *  transaction is bounded by (n + 1) * (normal time + 1 ms + 105 us). */
+void i2c_set_retries(const uint16_t n);
+/** Prints the error, retry and timeout counters of every device, on
+ *  either bus */
+void i2c_report(void);
+/** Moves a device to the bit-banged bus, see i2c_soft.h, or back to the
+ *  TWI. The functions below then transfer there, a short write returning
+ *  before it is out. */
+void i2c_set_soft(const uint8_t address, const bool soft);
+/** @return true while a transaction is in progress on the bus of the
+ *  device. An ISR that finds the bus busy has interrupted the main loop
+ *  in the middle of one and must leave the bus alone. */
+bool i2c_busy(const uint8_t address);
+/** Prints the last failed transaction, if any since the last call. Call
+ *  it from the main loop, transactions may fail in an ISR. */
+void i2c_flush_errors(void);
 void i2c_send(uint8_t address, const size_t N, const uint8_t bytes[N]);
+/** Sends the register address, or any other leading byte, then N bytes
+ *  from a separate buffer in the same transaction */
+void i2c_write_regs(uint8_t address, const uint8_t reg, const size_t N,
+		const uint8_t bytes[N]);
 uint8_t i2c_receive(uint8_t address, const uint8_t N, uint8_t bytes[N]);
+/** Writes the register address, then reads N bytes after a repeated START
+ *  @return number of bytes read
+ */
+uint8_t i2c_read_regs(uint8_t address, const uint8_t reg, const uint8_t N,
+		uint8_t bytes[N]);
 
 #endif /* _I2C_H */
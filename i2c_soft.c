@@ -0,0 +1,334 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+
+#include "i2c_soft.h"
+#include "clock.h"
+
+#define BIT(n) (1 << (n))
+
+#define SDA BIT(PD6)
+#define SCL BIT(PD7)
+
+/* Timer0 in CTC mode at clk/8 */
+#define I2C_SOFT_OCR (F_CPU / 8 / 1000000UL * I2C_SOFT_STEP_US - 1)
+_Static_assert(I2C_SOFT_OCR > 0 && I2C_SOFT_OCR < 256,
+		"I2C_SOFT_STEP_US out of the Timer0 range");
+
+/* Cycles of the low and the high half of a bit besides the port accesses
+ * around them: 40 a bit, 400 kHz at 16 MHz, with SCL low for the 1.3 us
+ * the slaves need */
+#define I2C_SOFT_LOW_CYCLES  16
+#define I2C_SOFT_HIGH_CYCLES 14
+
+/* Polls of a released SCL held low by a slave, about 0.1 ms */
+#define I2C_SOFT_STRETCH 255
+
+/* No byte for that long means the timer is gone */
+#define I2C_SOFT_TIMEOUT_US 1000
+
+enum step {
+	STEP_IDLE,
+	STEP_START,   /* START, SLA */
+	STEP_REG,
+	STEP_RESTART, /* repeated START, SLA+R */
+	STEP_DATA
+};
+
+static struct {
+	uint8_t address;
+	bool read;
+	int16_t reg;
+	uint8_t *data;
+	uint16_t n;
+	volatile uint16_t pos;
+	volatile uint8_t step;
+	uint8_t retries;   /* attempts left */
+	struct i2c_counts *counts;
+} xfer;
+
+static uint8_t queued[I2C_SOFT_QUEUE];
+/* A caller is setting up a transaction, or waiting for its own */
+static volatile bool owned = false;
+
+/* Open drain: PORTD keeps both pins low, a line is driven low by making
+ * the pin an output and released by making it an input */
+static inline void sda_low(void)
+{
+	DDRD |= SDA;
+}
+
+static inline void sda_release(void)
+{
+	DDRD &= ~SDA;
+}
+
+static inline void scl_low(void)
+{
+	DDRD |= SCL;
+}
+
+/* Waits for a slave stretching the clock, not for a stuck one */
+static inline void scl_release(void)
+{
+	uint8_t i = I2C_SOFT_STRETCH;
+
+	DDRD &= ~SCL;
+	while (!(PIND & SCL) && --i);
+}
+
+static inline bool sda_read(void)
+{
+	return PIND & SDA;
+}
+
+/* One SCL pulse, SDA set up before */
+static inline void clock_bit(void)
+{
+	__builtin_avr_delay_cycles(I2C_SOFT_LOW_CYCLES);
+	scl_release();
+	__builtin_avr_delay_cycles(I2C_SOFT_HIGH_CYCLES);
+}
+
+/* Both lines high */
+static void start(void)
+{
+	sda_low();
+	__builtin_avr_delay_cycles(I2C_SOFT_HIGH_CYCLES);
+	scl_low();
+}
+
+/* SCL low after an ACK */
+static void restart(void)
+{
+	sda_release();
+	clock_bit();
+	sda_low();
+	__builtin_avr_delay_cycles(I2C_SOFT_HIGH_CYCLES);
+	scl_low();
+}
+
+static void stop(void)
+{
+	sda_low();
+	clock_bit();
+	sda_release();
+}
+
+/* @return true on an ACK */
+static bool write_byte(uint8_t c)
+{
+	uint8_t i;
+	bool ack;
+
+	for (i = 0; i < 8; i++, c <<= 1) {
+		if (c & 0x80)
+			sda_release();
+		else
+			sda_low();
+		clock_bit();
+		scl_low();
+	}
+	sda_release();
+	clock_bit();
+	ack = !sda_read();
+	scl_low();
+
+	return ack;
+}
+
+static uint8_t read_byte(const bool ack)
+{
+	uint8_t c = 0, i;
+
+	sda_release();
+	for (i = 0; i < 8; i++) {
+		clock_bit();
+		c = c << 1 | sda_read();
+		scl_low();
+	}
+	if (ack)
+		sda_low();
+	clock_bit();
+	scl_low();
+	sda_release();
+
+	return c;
+}
+
+/* Clocks SCL until the slave holding SDA low has shifted out the rest of
+ * its byte, then sends a STOP: 25 us at most */
+static void bus_clear(void)
+{
+	uint8_t i;
+
+	for (i = 0; i < 9 && !sda_read(); i++) {
+		scl_low();
+		clock_bit();
+	}
+	scl_low();
+	stop();
+}
+
+static void finish(void)
+{
+	stop();
+	xfer.step = STEP_IDLE;
+	TIMSK0 &= ~BIT(OCIE0A);
+}
+
+/* The first data byte, or the STOP if there is none */
+static void data_next(void)
+{
+	if (xfer.n)
+		xfer.step = STEP_DATA;
+	else
+		finish();
+}
+
+/* A byte per match with interrupts off, 23 us */
+ISR(TIMER0_COMPA_vect)
+{
+	switch (xfer.step) {
+		case STEP_START:
+			if (!sda_read()) {
+				xfer.counts->timeouts++;
+				bus_clear();
+				goto failed;
+			}
+			start();
+			if (!write_byte(xfer.address << 1 |
+						(xfer.read && xfer.reg < 0)))
+				goto failed;
+			if (xfer.reg >= 0)
+				xfer.step = STEP_REG;
+			else
+				data_next();
+			break;
+
+		case STEP_REG:
+			if (!write_byte(xfer.reg))
+				goto failed;
+			if (xfer.read)
+				xfer.step = STEP_RESTART;
+			else
+				data_next();
+			break;
+
+		case STEP_RESTART:
+			restart();
+			if (!write_byte(xfer.address << 1 | 1))
+				goto failed;
+			data_next();
+			break;
+
+		case STEP_DATA:
+			if (xfer.read)
+				xfer.data[xfer.pos] = read_byte(xfer.pos + 1 < xfer.n);
+			else if (!write_byte(xfer.data[xfer.pos]))
+				goto failed;
+			if (++xfer.pos == xfer.n)
+				finish();
+			break;
+
+		default:
+			TIMSK0 &= ~BIT(OCIE0A);
+			break;
+	}
+	return;
+
+failed:
+	/* Again from the START at the next match */
+	if (xfer.retries) {
+		xfer.retries--;
+		xfer.counts->retries++;
+		stop();
+		xfer.pos = 0;
+		xfer.step = STEP_START;
+		return;
+	}
+	xfer.counts->errors++;
+	finish();
+}
+
+void init_i2c_soft(void)
+{
+	PORTD &= ~(SDA | SCL);
+	DDRD &= ~(SDA | SCL);
+
+	TCCR0A = BIT(WGM01);
+	TCCR0B = BIT(CS01); /* clk/8 */
+	OCR0A = I2C_SOFT_OCR;
+	TIMSK0 &= ~BIT(OCIE0A);
+}
+
+bool i2c_soft_busy(void)
+{
+	return owned || xfer.step != STEP_IDLE;
+}
+
+/* Bounded by the progress of the transaction, not by its length. The
+ * time is taken first, an ISR may have run for long meanwhile. */
+static void i2c_soft_wait(void)
+{
+	uint16_t start = clock_ticks16(), pos = xfer.pos;
+	uint8_t step = xfer.step;
+
+	while (xfer.step != STEP_IDLE) {
+		const uint16_t now = clock_ticks16();
+
+		if (xfer.step != step || xfer.pos != pos) {
+			start = now;
+			step = xfer.step;
+			pos = xfer.pos;
+		} else if ((uint16_t)(now - start) >
+				I2C_SOFT_TIMEOUT_US * CLOCK_TICKS_PER_US) {
+			ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+				finish();
+				xfer.counts->timeouts++;
+				xfer.counts->errors++;
+			}
+			return;
+		}
+	}
+}
+
+void i2c_soft_flush(void)
+{
+	i2c_soft_wait();
+}
+
+size_t i2c_soft_transfer(const uint8_t address, const int16_t reg,
+		const bool read, const size_t N, uint8_t bytes[N],
+		const uint8_t retries, struct i2c_counts *counts)
+{
+	const bool queue = !read && N <= I2C_SOFT_QUEUE;
+	size_t n = N;
+
+	owned = true;
+	i2c_soft_wait();
+	xfer.address = address;
+	xfer.read = read;
+	xfer.reg = reg;
+	xfer.data = queue? memcpy(queued, bytes, N): bytes;
+	xfer.n = N;
+	xfer.pos = 0;
+	xfer.retries = retries;
+	xfer.counts = counts;
+	/* The next match starts it */
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		xfer.step = STEP_START;
+		TIMSK0 |= BIT(OCIE0A);
+	}
+	if (!queue) {
+		i2c_soft_wait();
+		n = xfer.pos;
+	}
+	owned = false;
+
+	return n;
+}
@@ -0,0 +1,59 @@
+#ifndef _I2C_SOFT_H
+#define _I2C_SOFT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/** Bit-banged I2C master on PD6 (SDA) and PD7 (SCL), external pull-ups.
+ *
+ *  A second bus next to the TWI, for boards where the display or the
+ *  sensors are wired to spare pins. It isn't used directly: i2c.c routes
+ *  the devices given to i2c_set_soft() here, see i2c.h.
+ *
+ *  Timer0 runs the transaction, one byte per compare match with the bits
+ *  cycle counted at 400 kHz for 16 MHz, so the main loop and the TWI go
+ *  on in between. Writes up to I2C_SOFT_QUEUE bytes are copied and go out
+ *  in the background, the others return once done.
+ *
+ *  As on the TWI, a NACK is retried from the START up to the given number
+ *  of times. A START finding SDA held low by a slave, left over from an
+ *  interrupted transaction, first clears the bus with up to nine clocks on
+ *  PD7 and a STOP. That and a lost timer count as timeouts. The counters
+ *  are the caller's, see struct i2c_counts.
+ */
+
+/* Bytes of a write that doesn't wait for the bus */
+#define I2C_SOFT_QUEUE 40
+
+/* Time between two bytes, a byte takes 23 us */
+#define I2C_SOFT_STEP_US 40
+
+/** Outcome of the transactions of a device. i2c.c keeps one per device
+ *  for either bus, the ISR updates it for a write in the background. */
+struct i2c_counts {
+	uint16_t errors;   /* transactions failed after all retries */
+	uint16_t retries;
+	uint16_t timeouts; /* each followed by a bus clear */
+};
+
+/** Takes over Timer0, and PD6 and PD7 as open drain lines */
+void init_i2c_soft(void);
+
+/** @return true while a transaction is queued or in progress */
+bool i2c_soft_busy(void);
+
+/** One transaction as in i2c.c: the register address if reg is not
+ *  negative, then N bytes written, or read after a repeated START
+ *  @param retries attempts repeated after a failed one
+ *  @param counts of the device, updated until the transaction is over
+ *  @return number of bytes transferred, or queued
+ */
+size_t i2c_soft_transfer(const uint8_t address, const int16_t reg,
+		const bool read, const size_t N, uint8_t bytes[N],
+		const uint8_t retries, struct i2c_counts *counts);
+
+/** Waits for a write still going out */
+void i2c_soft_flush(void);
+
+#endif /* _I2C_SOFT_H */
@@ -0,0 +1,41 @@
+#include <stdint.h>
+
+#include "i2c_trace.h"
+#include "telemetry.h"
+#include "frame.h"
+#include "uart.h"
+
+#ifdef I2C_TRACE
+
+/* Events per frame */
+#define I2C_TRACE_BATCH 16
+
+struct i2c_trace_event i2c_trace_ring[I2C_TRACE_SIZE];
+volatile uint8_t i2c_trace_head = 0, i2c_trace_tail = 0;
+uint8_t i2c_trace_dropped = 0;
+
+void i2c_trace_flush(void)
+{
+	struct {
+		struct i2c_trace_header h;
+		struct i2c_trace_event e[I2C_TRACE_BATCH];
+	} __attribute__((packed)) p;
+	uint8_t tail = i2c_trace_tail;
+
+	/* Worst case COBS overhead of a frame is 3 bytes */
+	while (tail != i2c_trace_head && uart_tx_free() >= sizeof(p) + 3) {
+		uint8_t n = 0;
+
+		while (tail != i2c_trace_head && n < I2C_TRACE_BATCH)
+			p.e[n++] = i2c_trace_ring[tail++ & I2C_TRACE_MASK];
+		i2c_trace_tail = tail;
+
+		p.h.type = TELEMETRY_I2C_TRACE;
+		p.h.dropped = i2c_trace_dropped;
+		i2c_trace_dropped = 0;
+		frame_send(uart_put, (const uint8_t *)&p,
+				sizeof(p.h) + n * sizeof(p.e[0]));
+	}
+}
+
+#endif /* I2C_TRACE */
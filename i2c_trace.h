@@ -0,0 +1,100 @@
+#ifndef _I2C_TRACE_H
+#define _I2C_TRACE_H
+
+#include <stdint.h>
+
+/** Binary I2C bus tracer.
+ *
+ *  Enabled with I2C_TRACE. Every transaction leaves a START record (SLA
+ *  byte, followed by a TIME record with the upper timestamp half), one
+ *  record per TWSR status, where repeats of the same status are merged, and
+ *  a STOP record with the error code. Recording costs a few cycles per
+ *  event, i2c_trace_flush() drains the ring as frames over the UART in
+ *  idle time. tools/i2c_trace_decode renders them as a timeline.
+ */
+
+enum I2C_TRACE_EVENT {
+	I2C_TRACE_EV_START = 1,
+	I2C_TRACE_EV_TIME,
+	I2C_TRACE_EV_STOP
+};
+
+struct i2c_trace_event {
+	uint8_t status; /* TWSR, or one of I2C_TRACE_EV_* */
+	uint8_t arg;    /* repeat count, SLA byte, timestamp or error */
+	uint16_t ts;    /* low half of clock_ticks() */
+} __attribute__((packed));
+
+/* Payload of a trace frame, followed by the events */
+struct i2c_trace_header {
+	uint8_t type;    /* TELEMETRY_I2C_TRACE */
+	uint8_t dropped; /* events lost since the previous frame, saturated */
+} __attribute__((packed));
+
+#ifdef I2C_TRACE
+
+#include "clock.h"
+
+#define I2C_TRACE_SIZE 32
+#define I2C_TRACE_MASK (I2C_TRACE_SIZE - 1)
+
+extern struct i2c_trace_event i2c_trace_ring[I2C_TRACE_SIZE];
+extern volatile uint8_t i2c_trace_head, i2c_trace_tail;
+extern uint8_t i2c_trace_dropped;
+
+static inline void i2c_trace_put(const uint8_t status, const uint8_t arg,
+		const uint16_t ts)
+{
+	const uint8_t head = i2c_trace_head;
+	struct i2c_trace_event *e = &i2c_trace_ring[head & I2C_TRACE_MASK];
+
+	if ((uint8_t)(head - i2c_trace_tail) == I2C_TRACE_SIZE) {
+		if (i2c_trace_dropped != 0xff)
+			i2c_trace_dropped++;
+		return;
+	}
+
+	e->status = status;
+	e->arg = arg;
+	e->ts = ts;
+	i2c_trace_head = head + 1;
+}
+
+static inline void i2c_trace_start(const uint8_t sla)
+{
+	const uint32_t t = clock_ticks();
+
+	i2c_trace_put(I2C_TRACE_EV_START, sla, t);
+	i2c_trace_put(I2C_TRACE_EV_TIME, 0, t >> 16);
+}
+
+static inline void i2c_trace_status(const uint8_t twsr)
+{
+	const uint8_t head = i2c_trace_head;
+	struct i2c_trace_event *e =
+		&i2c_trace_ring[(uint8_t)(head - 1) & I2C_TRACE_MASK];
+
+	if (head != i2c_trace_tail && e->status == twsr && e->arg != 0xff)
+		e->arg++;
+	else
+		i2c_trace_put(twsr, 1, clock_ticks16());
+}
+
+static inline void i2c_trace_stop(const uint8_t err)
+{
+	i2c_trace_put(I2C_TRACE_EV_STOP, err, clock_ticks16());
+}
+
+/** Sends recorded events while the UART has room for them */
+void i2c_trace_flush(void);
+
+#else
+
+static inline void i2c_trace_start(const uint8_t sla) {}
+static inline void i2c_trace_status(const uint8_t twsr) {}
+static inline void i2c_trace_stop(const uint8_t err) {}
+static inline void i2c_trace_flush(void) {}
+
+#endif /* I2C_TRACE */
+
+#endif /* _I2C_TRACE_H */
@@ -0,0 +1,85 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "latency.h"
+#include "uart.h"
+
+static struct {
+	uint16_t buckets[LATENCY_BUCKETS];
+	uint16_t count;
+	uint32_t min, max;
+	uint32_t sum;
+} lat;
+
+void latency_reset(void)
+{
+	memset(&lat, 0, sizeof(lat));
+	lat.min = UINT32_MAX;
+}
+
+void latency_record(const uint32_t us)
+{
+	uint8_t i = 0;
+	uint32_t v = us >> LATENCY_SHIFT;
+
+	/* Saturated, so the mean stays correct for the recorded part */
+	if (lat.count == UINT16_MAX)
+		return;
+
+	while (v && i < LATENCY_BUCKETS - 1) {
+		v >>= 1;
+		i++;
+	}
+
+	lat.buckets[i]++;
+	lat.count++;
+	lat.sum += us;
+	if (us < lat.min)
+		lat.min = us;
+	if (us > lat.max)
+		lat.max = us;
+}
+
+/* Linear interpolation inside the bucket holding the percentile */
+static uint32_t latency_percentile(const uint8_t percent)
+{
+	const uint32_t rank = ((uint32_t)lat.count * percent + 99) / 100;
+	uint32_t below = 0;
+	uint8_t i;
+
+	for (i = 0; i < LATENCY_BUCKETS; i++) {
+		const uint16_t n = lat.buckets[i];
+
+		if (below + n >= rank) {
+			const uint32_t lo = i? 1UL << (i + LATENCY_SHIFT - 1): 0;
+			const uint32_t hi = 1UL << (i + LATENCY_SHIFT);
+			uint32_t p = lo + (hi - lo) * (rank - below) / n;
+
+			return p > lat.max? lat.max: p;
+		}
+		below += n;
+	}
+
+	return lat.max;
+}
+
+void latency_report(void)
+{
+	uint8_t i;
+
+	if (!lat.count) {
+		printb("latency: no frames\r\n");
+		return;
+	}
+
+	printb("latency us: min %" PRIu32 ", mean %" PRIu32 ", p99 %" PRIu32
+			", max %" PRIu32 " (%u frames)\r\n",
+			lat.min, lat.sum / lat.count, latency_percentile(99),
+			lat.max, lat.count);
+	for (i = 0; i < LATENCY_BUCKETS; i++)
+		if (lat.buckets[i])
+			printb("  < %7" PRIu32 ": %u\r\n",
+					(uint32_t)1 << (i + LATENCY_SHIFT),
+					lat.buckets[i]);
+}
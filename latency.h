@@ -0,0 +1,26 @@
+#ifndef _LATENCY_H
+#define _LATENCY_H
+
+#include <stdint.h>
+
+/** Motion-to-photon latency histogram.
+ *
+ *  Latencies from sample acquisition to the end of the flush of the frame
+ *  showing it, in log2 buckets: bucket i counts [2^(i+9), 2^(i+10)) us,
+ *  except for the first one, [0, 1024) us, and the last one, which holds
+ *  everything from 2^(LATENCY_BUCKETS + 8) us up. A page alone takes
+ *  longer than a millisecond on the bus, finer buckets would stay empty.
+ */
+
+#define LATENCY_BUCKETS 11
+/* log2 of the lower bound of the second bucket */
+#define LATENCY_SHIFT 10
+
+void latency_record(const uint32_t us);
+
+/** Prints min/mean/p99/max and the non-empty buckets */
+void latency_report(void);
+
+void latency_reset(void);
+
+#endif /* _LATENCY_H */
@@ -0,0 +1,78 @@
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdbool.h>
+
+#include <avr/pgmspace.h>
+
+#include "log.h"
+#include "uart.h"
+
+/* Records are stored as | fmt lo | fmt hi | size | args... | and never
+ * split: a record either fits into the queue as a whole or is dropped.
+ * The longest ones take 15 bytes, so 64 holds four of them. */
+#define LOG_QUEUE_SIZE 64
+#define LOG_QUEUE_MASK (LOG_QUEUE_SIZE - 1)
+#define LOG_RECORD_HEADER 3
+_Static_assert(!(LOG_QUEUE_SIZE & LOG_QUEUE_MASK) && LOG_QUEUE_SIZE <= 128,
+		"LOG_QUEUE_SIZE must be a power of two up to 128");
+
+/* Do not start formatting a record unless the TX ring has that much room */
+#define LOG_FLUSH_MIN_TX_FREE 48
+
+uint16_t log_level = LOG_LEVEL;
+static uint16_t log_lost = 0;
+
+#ifdef __AVR__
+
+static uint8_t log_queue[LOG_QUEUE_SIZE];
+static volatile uint8_t log_head = 0, log_tail = 0;
+
+void log_record(const char *fmt, const void *args, const uint8_t size)
+{
+	const uint8_t *a = args;
+	uint8_t head = log_head;
+	uint8_t i;
+
+	if (LOG_QUEUE_SIZE - (uint8_t)(head - log_tail) <
+			LOG_RECORD_HEADER + size) {
+		log_lost++;
+		return;
+	}
+
+	log_queue[head++ & LOG_QUEUE_MASK] = (uint16_t)fmt & 0xff;
+	log_queue[head++ & LOG_QUEUE_MASK] = (uint16_t)fmt >> 8;
+	log_queue[head++ & LOG_QUEUE_MASK] = size;
+	for (i = 0; i < size; i++)
+		log_queue[head++ & LOG_QUEUE_MASK] = a[i];
+
+	log_head = head;
+}
+
+void log_flush(void)
+{
+	uint8_t tail = log_tail;
+
+	while (tail != log_head && uart_tx_free() >= LOG_FLUSH_MIN_TX_FREE) {
+		uint8_t args[LOG_MAX_ARGS_SIZE];
+		uint16_t fmt;
+		uint8_t i, size;
+
+		fmt = log_queue[tail++ & LOG_QUEUE_MASK];
+		fmt |= log_queue[tail++ & LOG_QUEUE_MASK] << 8;
+		size = log_queue[tail++ & LOG_QUEUE_MASK];
+		for (i = 0; i < size; i++)
+			args[i] = log_queue[tail++ & LOG_QUEUE_MASK];
+		log_tail = tail;
+
+		/* avr-gcc passes variadic arguments on the stack without any
+		 * padding and its va_list is a plain pointer into it */
+		vfprintf_P(uart_out, (const char *)fmt, (va_list)args);
+	}
+}
+
+#endif /* __AVR__ */
+
+uint16_t log_dropped(void)
+{
+	return log_lost;
+}
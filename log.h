@@ -0,0 +1,97 @@
+#ifndef _LOG_H
+#define _LOG_H
+
+#include <stdint.h>
+
+#include <avr/pgmspace.h>
+
+/** Deferred logging.
+ *
+ *  A log call only copies the PROGMEM format pointer and the raw, already
+ *  promoted argument bytes into a queue. Formatting happens in log_flush(),
+ *  which is meant to be called from idle time, so the caller pays a few
+ *  dozen cycles regardless of the format. Calls above LOG_LEVEL compile to
+ *  nothing, the ones above log_level are skipped at runtime.
+ *
+ *  As arguments are formatted later, pointers (%s, %S) must stay valid
+ *  until then, i.e. point to static or PROGMEM strings.
+ */
+
+enum LOG_LEVELS {
+	LOG_LEVEL_ERR,
+	LOG_LEVEL_WARN,
+	LOG_LEVEL_INFO,
+	LOG_LEVEL_DEBUG
+};
+
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+/* Runtime verbosity, on top of LOG_LEVEL */
+extern uint16_t log_level;
+
+/* Upper limit of the argument bytes of a single record */
+#define LOG_MAX_ARGS_SIZE 16
+
+/** @return number of records lost to a full queue */
+uint16_t log_dropped(void);
+
+#ifdef __AVR__
+
+void log_record(const char *fmt, const void *args, const uint8_t size);
+
+/** Formats and sends queued records while the UART has room for them */
+void log_flush(void);
+
+/* Argument capture: every argument becomes a field of a packed struct,
+ * typed after its promoted type, which matches the avr-gcc stack layout of
+ * variadic arguments byte for byte. */
+#define _LOG_CAT_(a, b) a##b
+#define _LOG_CAT(a, b) _LOG_CAT_(a, b)
+#define _LOG_NARGS_(_0, _1, _2, _3, _4, _5, _6, N, ...) N
+#define _LOG_NARGS(...) _LOG_NARGS_(_, ##__VA_ARGS__, 6, 5, 4, 3, 2, 1, 0)
+#define _LOG_FIELD(n, x) __typeof__((x) + 0) a##n;
+#define _LOG_FIELDS_0()
+#define _LOG_FIELDS_1(a) _LOG_FIELD(1, a)
+#define _LOG_FIELDS_2(a, b) _LOG_FIELDS_1(a) _LOG_FIELD(2, b)
+#define _LOG_FIELDS_3(a, b, c) _LOG_FIELDS_2(a, b) _LOG_FIELD(3, c)
+#define _LOG_FIELDS_4(a, b, c, d) _LOG_FIELDS_3(a, b, c) _LOG_FIELD(4, d)
+#define _LOG_FIELDS_5(a, b, c, d, e) _LOG_FIELDS_4(a, b, c, d) _LOG_FIELD(5, e)
+#define _LOG_FIELDS_6(a, b, c, d, e, f) _LOG_FIELDS_5(a, b, c, d, e) _LOG_FIELD(6, f)
+#define _LOG_FIELDS(...) \
+	_LOG_CAT(_LOG_FIELDS_, _LOG_NARGS(__VA_ARGS__))(__VA_ARGS__)
+
+#define LOG(level, fmt, ...) do { \
+	if ((level) <= LOG_LEVEL && (level) <= log_level) { \
+		static const char _log_fmt[] PROGMEM = fmt; \
+		const struct __attribute__((packed)) { \
+			_LOG_FIELDS(__VA_ARGS__) \
+		} _log_args = { __VA_ARGS__ }; \
+		_Static_assert(sizeof(_log_args) <= LOG_MAX_ARGS_SIZE, \
+				"too many log arguments"); \
+		log_record(_log_fmt, &_log_args, sizeof(_log_args)); \
+	} \
+} while (0)
+
+#else
+
+/* There is no portable way to build a va_list from the raw arguments, other
+ * targets (the host build) format right away */
+#include "uart.h"
+
+#define LOG(level, fmt, ...) do { \
+	if ((level) <= LOG_LEVEL && (level) <= log_level) \
+		printb(fmt, ##__VA_ARGS__); \
+} while (0)
+
+static inline void log_flush(void) {}
+
+#endif /* __AVR__ */
+
+#define log_err(fmt, ...)   LOG(LOG_LEVEL_ERR, fmt, ##__VA_ARGS__)
+#define log_warn(fmt, ...)  LOG(LOG_LEVEL_WARN, fmt, ##__VA_ARGS__)
+#define log_info(fmt, ...)  LOG(LOG_LEVEL_INFO, fmt, ##__VA_ARGS__)
+#define log_debug(fmt, ...) LOG(LOG_LEVEL_DEBUG, fmt, ##__VA_ARGS__)
+
+#endif /* _LOG_H */
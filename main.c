@@ -1,25 +1,50 @@
 #include <stdbool.h>
 #include <string.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <stdarg.h>
 
 #include <avr/io.h>
 #include <avr/interrupt.h>
+#include <avr/sleep.h>
 #include <math.h>
 
 #include "uart.h"
 #include "i2c.h"
+#include "log.h"
+#include "clock.h"
+#include "telemetry.h"
+#include "shell.h"
+#include "perf.h"
+#include "i2c_trace.h"
+#include "latency.h"
+#include "gfx.h"
+#include "replay.h"
+#include "fixmath.h"
+#include "wire3d.h"
+#include "spectrum.h"
+#include "motion.h"
+#include "fusion.h"
+#include "filter.h"
+#include "gyro.h"
+#include "compass.h"
+#include "calib.h"
+#include "boot.h"
+#include "sensor.h"
+#include "stack.h"
+#include "sampler.h"
 
 #include "img.h"
 #include <avr/pgmspace.h>
 
 #define BIT(x) (1 << (x))
 
+#ifndef UART_BAUDRATE
+#define UART_BAUDRATE 115200
+#endif
+
 
 static const uint8_t DISPLAY_ADDR = 0x3c;
-static const uint8_t GYRO_ADDR = 0x69;
-static const uint8_t COMPASS_ADDR = 0x1e;
-static const uint8_t ACC_ADDR = 0x53;
 
 enum {
 	DISPLAY_ON_OFF = 0xae,
@@ -32,7 +57,9 @@ enum {
 	DISPLAY_INVERSION       = 0xa6,
 	DISPLAY_PRECHARGEPERIOD = 0xd9,
 	DISPLAY_CHARGE          = 0x8d,
-	DISPLAY_ADDRESSING_MODE = 0x20
+	DISPLAY_ADDRESSING_MODE = 0x20,
+	DISPLAY_COLUMN_ADDR     = 0x21,
+	DISPLAY_PAGE_ADDR       = 0x22
 };
 
 #if 0
@@ -60,21 +87,6 @@ ISR(EXT_INTERRUPT_vect) {
 
 
 
-/* Timer routines */
-//TODO: cleanup
-static void init_timers(void) {
-	/* Timer initialization, 0 to comparator, see ISR below */
-	TCCR1A = 0;
-	TCCR1B = (1 << WGM12) | (1 << CS12) | (1 << CS10); /* comparator and prescaler */
-	OCR1A = 15624;
-	//TIMSK1 = 1 << OCIE1A;
-}
-
-ISR(TIMER1_COMPA_vect) {
-//	print_polling("X\r\n");
-}
-
-
 /* Bad example of the delay, but good example of a volatile mine */
 static void mydelay_us(uint32_t us) {
 	const uint8_t TICKS_IN_1uS = F_CPU/1000000L;
@@ -100,14 +112,18 @@ static void mydelay_ms(unsigned short ms) {
 void hw_init() {
 	cli();
 
-	init_uart(115200);
+	/* Fall back to a rate any terminal can take */
+	if (init_uart(UART_BAUDRATE))
+		init_uart(115200);
 	//init_interrupt();
-	init_timers();
+	init_clock();
 	init_i2c();
 
 	sei();
 
-	printb("Initialization finished\r\n");
+	printb("Initialization finished, UART error %c%d.%d%%\r\n",
+			uart_baud_error() < 0? '-': '+',
+			abs(uart_baud_error()) / 10, abs(uart_baud_error()) % 10);
 }
 
 bool display_command(uint8_t N, ...)
@@ -132,163 +148,707 @@ bool display_command(uint8_t N, ...)
 	return true;
 }
 
-void putpixel(uint8_t b[], uint8_t x, uint8_t y, bool set)
+/* Points the RAM at the top left corner, so a frame cut short by a bus
+ * error doesn't shift the next one */
+static void display_home()
 {
-	if (x < 128 && y < 64) {
-		const uint8_t MASK = 1 << (y & 7);
-		const uint16_t pos = ((y & ~7) << 4) + x;
-		if (set)
-			b[pos] |= MASK;
-		else
-			b[pos] &= ~MASK;
-	}
+	display_command(3, DISPLAY_COLUMN_ADDR, 0, GFX_WIDTH - 1);
+	display_command(3, DISPLAY_PAGE_ADDR, 0, GFX_HEIGHT / 8 - 1);
+}
+
+/* The screen goes out a page at a time, each one drawn into the band
+ * right before its chunks, see render() */
+static uint8_t band[GFX_WIDTH];
+
+static void render(const uint8_t page);
+
+static bool init_display()
+{
+	display_command(1, DISPLAY_ON_OFF | 0);
+	display_command(2, DISPLAY_ADDRESSING_MODE, 0);
+	display_command(1, DISPLAY_INVERSION | 0);
+	display_command(2, DISPLAY_CHARGE, 0x14);
+	display_command(1, DISPLAY_ON_OFF | 1);
+	display_home();
+	return true;
 }
 
-void line(uint8_t b[], long x0, long y0, long x1, long y1)
+/* Bytes per display transaction, 3 ms at 100 kHz. The sampler only gets
+ * a shared bus in between. On the bit-banged bus a chunk is a write that
+ * goes out in the background, see I2C_SOFT_QUEUE. */
+#define DISPLAY_CHUNK 32
+_Static_assert(!(GFX_WIDTH % DISPLAY_CHUNK), "a chunk spans two pages");
+
+/* Sends the next chunk of the screen, drawing the page first if it
+ * starts there
+ * @return true once the whole screen is out */
+static bool display_send()
 {
-	long incx = (x1 > x0)? 1: -1;
-	long incy = (y1 > y0)? 1: -1;
-	const long dx = ((long)x1 - x0)*incx;
-	const long dy = ((long)y0 - y1)*incy;
-	long e = dx + dy;
+	static uint16_t pos = 0;
 
-	while ((x0 != x1) || (y0 != y1)) {
-		const long double_e = e << 1;
-		if (x0 > 0 && y0 >0 && x0 <127 && y0 < 63)
-			putpixel(b, x0, y0, true);
-		if (double_e >= dy) {
-			e += dy;
-			x0 += incx;
-		}
-		if (double_e <= dx) {
-			e += dx;
-			y0 += incy;
-		}
+	if (!(pos % GFX_WIDTH)) {
+		PERF_START(t_render);
+		render(pos / GFX_WIDTH);
+		PERF_STOP(render, t_render);
 	}
+	PERF_START(t_flush);
+	if (!pos)
+		display_home();
+	i2c_write_regs(DISPLAY_ADDR, 0x40, DISPLAY_CHUNK,
+			&band[pos % GFX_WIDTH]);
+	PERF_STOP(flush, t_flush);
+	pos += DISPLAY_CHUNK;
+	if (pos < GFX_SIZE)
+		return false;
+	pos = 0;
+	return true;
 }
 
-struct screen {
-	uint8_t data_sign_holder;
-	uint8_t b[1024];
-} __attribute__((packed));
+/* Samples per poll out of the ADXL345 FIFO at high rates, the display
+ * still gets a fresh one every 10 ms at the low ones */
+#define ACC_POLL_SAMPLES 8
+#define ACC_POLL_US      10000
 
-void dump_buffer(struct screen *s)
+/* Picks the fastest ADXL345 output data rate not above hz
+ * @return the rate picked */
+static uint16_t set_acc_odr(const uint16_t hz)
 {
-	s->data_sign_holder = 0x40;
-	i2c_send(DISPLAY_ADDR, sizeof(*s), (uint8_t*)s);
+	uint8_t rate = 0x0f; /* 3200 Hz */
+	uint16_t odr;
+	uint32_t us;
+
+	while (rate > 0x06 && (3200 >> (0x0f - rate)) > hz)
+		rate--;
+	odr = 3200 >> (0x0f - rate);
+	sensor_write(SENSOR_ID_ACC, 0x2c, 1, &rate);
+
+	us = ACC_POLL_SAMPLES * 1000000UL / odr;
+	sensor_set_period(SENSOR_ID_ACC, us < ACC_POLL_US? us: ACC_POLL_US);
+	sampler_set_interval(SENSOR_ID_ACC, 1000000UL / odr);
+	spectrum_set_rate(odr);
+	return odr;
 }
 
-static struct screen s;
-void init_display()
+/* OFSX..OFSZ are added by the chip to every sample */
+void set_acc_offset(const int8_t ofs[3])
 {
-	display_command(1, DISPLAY_ON_OFF | 0);
-	display_command(2, DISPLAY_ADDRESSING_MODE, 0);
-	display_command(1, DISPLAY_INVERSION | 0);
-	display_command(2, DISPLAY_CHARGE, 0x14);
-	display_command(1, DISPLAY_ON_OFF | 1);
+	sensor_write(SENSOR_ID_ACC, 0x1e, 3, (const uint8_t *)ofs);
+}
 
-	printb("Display init_done\r\n");
+/* What the display shows */
+enum {
+	DISPLAY_HORIZON,
+	DISPLAY_CUBE,
+	DISPLAY_AIRCRAFT,
+	DISPLAY_SPECTRUM
+};
 
-	memcpy_P(s.b, header_data, sizeof(header_data));
-	//line(s.b, 0, 31, 127, 31);
-	//line(s.b, 127, 0, 0, 63);
-	//line(s.b, 0, 0, 127, 63);
-	dump_buffer(&s);
+/* Devices wired to the bit-banged bus, see i2c_soft.h */
+enum {
+	I2C_SOFT_NONE,
+	I2C_SOFT_DISPLAY,
+	I2C_SOFT_SENSORS
+};
+
+#ifndef I2C_SOFT_DEVICES
+#define I2C_SOFT_DEVICES I2C_SOFT_NONE
+#endif
+
+/* Runtime parameters, see the shell */
+enum {
+	SENSOR_ACC     = BIT(SENSOR_ID_ACC),
+	SENSOR_GYRO    = BIT(SENSOR_ID_GYRO),
+	SENSOR_COMPASS = BIT(SENSOR_ID_COMPASS)
+};
+
+static uint16_t acc_odr = 100;
+static uint16_t gyro_odr = 400;
+static uint16_t display_hz = 30;
+static uint16_t display_mode = DISPLAY_HORIZON;
+static uint16_t i2c_khz = 100;
+static uint16_t i2c_retry = 2;
+static uint16_t sensors = SENSOR_ACC;
+static uint16_t telemetry = TELEMETRY_TEXT;
+static uint16_t loop_ms = 10;
+static uint16_t stats_s = 0;
+static uint16_t filter_type = FILTER_NONE;
+static uint16_t decimation = 1;
+static uint16_t i2c_soft = I2C_SOFT_DEVICES;
+static uint16_t fft_axis = 2;
+static uint16_t inact_s = MOTION_INACTIVITY_S;
+static uint16_t sleep_on = 0;
+
+static struct filter acc_filter, compass_filter;
+
+/* An ADXL345 FIFO read, a sample per transaction, holds the bus for about
+ * 0.9 ms at 100 kHz. The FIFO would overrun at a rate the bus can't
+ * carry, so the rate is capped to it and acc_odr shows the one applied.
+ * The bit-banged bus, at 400 kHz, is no slower than i2c_khz. */
+#define ACC_READ_US_100KHZ 900UL
+
+static void set_acc_rate(const uint16_t hz)
+{
+	const uint32_t max = 1000000UL * i2c_khz / (ACC_READ_US_100KHZ * 100);
+
+	acc_odr = set_acc_odr(hz < max? hz: max);
 }
 
-void init_gyro()
+static void set_i2c_khz(const uint16_t khz)
 {
-	uint8_t mode[2] = { 0x20, 0x0f };
-	i2c_send(GYRO_ADDR, sizeof(mode), mode);
+	i2c_set_clock(khz);
+	set_acc_rate(acc_odr);
 }
 
-void read_gyro(int16_t v[])
+/* The sampler is held off while the FIFO restarts */
+static void set_gyro_odr(const uint16_t hz)
 {
-	const uint8_t get_cmd = 0x28 | BIT(7);
-	i2c_send(GYRO_ADDR, 1, &get_cmd);
-	i2c_receive(GYRO_ADDR, 6, (uint8_t *)v);
-#if 0
-	v[0] = (v[0] << 8) | ((v[0] & 0xff00) >> 8);
-	v[1] = (v[1] << 8) | ((v[1] & 0xff00) >> 8);
-	v[2] = (v[2] << 8) | ((v[2] & 0xff00) >> 8);
-#endif
+	uint16_t odr;
+
+	sampler_pause();
+	odr = init_gyro(hz);
+	sampler_resume();
+	sampler_set_interval(SENSOR_ID_GYRO, 1000000UL / odr);
+	fusion_set_gyro(odr, sensor_scale(SENSOR_ID_GYRO));
 }
 
-void read_compass(int16_t v[])
+/* The main loop hands the mask to the sampler */
+static void set_sensors(const uint16_t mask)
 {
-	const uint8_t get_cmd = 0x03;
-	i2c_receive(COMPASS_ADDR, 6, (uint8_t *)v);
-	i2c_send(COMPASS_ADDR, 1, &get_cmd);
-#if 1
-	v[0] = (v[0] << 8) | ((v[0] & 0xff00) >> 8);
-	v[1] = (v[1] << 8) | ((v[1] & 0xff00) >> 8);
-	v[2] = (v[2] << 8) | ((v[2] & 0xff00) >> 8);
-#endif
+	static uint16_t enabled = SENSOR_ACC | SENSOR_COMPASS;
+
+	if (mask & ~enabled & SENSOR_GYRO)
+		set_gyro_odr(gyro_odr);
+	if (mask & ~enabled & SENSOR_ACC)
+		sensor_init(SENSOR_ID_ACC);
+	enabled |= mask;
 }
 
-int init_compass()
+static void set_i2c_soft(const uint16_t devices)
 {
-	const uint16_t MAX_THRESHOLD = 575;
-	const uint16_t MIN_THRESHOLD = 243;
-	const uint8_t get_cmd = 0x03;
-	uint8_t ctrl[2] = { 0x00, 0x71 };
-	uint8_t gain[2] = { 0x01, 0xa0 };
-	const uint8_t mode[2] = { 0x02, 0x00 };
-	int16_t v[3];
+	uint8_t id;
 
-	printb("Compass self-test... ");
-	i2c_send(COMPASS_ADDR, sizeof(ctrl), ctrl);
-	i2c_send(COMPASS_ADDR, sizeof(gain), gain);
-	i2c_send(COMPASS_ADDR, sizeof(mode), mode);
-	i2c_send(COMPASS_ADDR, 1, &get_cmd);
-
-	mydelay_ms(10);
-
-	read_compass(v);
-	if ((v[0] > MAX_THRESHOLD || v[1] > MAX_THRESHOLD || v[2] > MAX_THRESHOLD) ||
-		(v[0] < MIN_THRESHOLD || v[1] < MIN_THRESHOLD || v[2] < MIN_THRESHOLD)) {
-		printb("error: %+hd/%+hd/%+hd\r\n", v[0], v[1], v[2]);
-		return -1;
-	} else
-		printb("ok\r\n");
-
-	ctrl[1] = 0x18;
-	//gain[1] = 0x20;
-	i2c_send(COMPASS_ADDR, sizeof(ctrl), ctrl);
-	//i2c_send(COMPASS_ADDR, sizeof(gain), gain);
-	i2c_send(COMPASS_ADDR, 1, &get_cmd);
-	mydelay_ms(10);
+	i2c_set_soft(DISPLAY_ADDR, devices == I2C_SOFT_DISPLAY);
+	for (id = 0; id < SENSOR_COUNT; id++)
+		i2c_set_soft(sensor_address(id), devices == I2C_SOFT_SENSORS);
+}
 
-	return 0;
+/* At rest after an inactivity event with sleep on, until activity: the
+ * sampler and the display are off, the CPU idles between interrupts */
+static bool resting = false;
+
+static void rest(const bool on)
+{
+	if (on == resting)
+		return;
+	resting = on;
+	if (on)
+		sampler_pause();
+	display_command(1, DISPLAY_ON_OFF | !on);
+	if (!on)
+		sampler_resume();
 }
 
-void init_acc()
+static void set_sleep(const uint16_t on)
 {
-	uint8_t mode[2] = { 0x2d, 0x08 };
-	i2c_send(ACC_ADDR, sizeof(mode), mode);
+	if (!on)
+		rest(false);
 }
 
-void read_acc(int16_t v[])
+static void set_filter(const uint16_t unused)
 {
-	const uint8_t get_cmd = 0x32;
-	i2c_send(ACC_ADDR, 1, &get_cmd);
-	i2c_receive(ACC_ADDR, 6, (uint8_t *)v);
-#if 0
-	v[0] = (v[0] << 8) | ((v[0] & 0xff00) >> 8);
-	v[1] = (v[1] << 8) | ((v[1] & 0xff00) >> 8);
-	v[2] = (v[2] << 8) | ((v[2] & 0xff00) >> 8);
-#endif
+	filter_init(&acc_filter, filter_type, decimation);
+	filter_init(&compass_filter, filter_type, decimation);
 }
 
-void init() {
+static void set_telemetry(const uint16_t mode)
+{
+	telemetry_flush();
+	telemetry_mode = mode;
+}
+
+static const struct shell_param params[] PROGMEM = {
+	{ "acc_odr",   &acc_odr,    6,  3200, set_acc_rate },
+	{ "gyro_odr",  &gyro_odr,   100, 800, set_gyro_odr },
+	{ "disp_hz",   &display_hz, 1,  100,  NULL },
+	{ "disp_mode", &display_mode, DISPLAY_HORIZON, DISPLAY_SPECTRUM, NULL },
+	{ "fft_axis",  &fft_axis,   0,  2,    NULL },
+	{ "inact_s",   &inact_s,    1,  255,  motion_set_inactivity },
+	{ "sleep",     &sleep_on,   0,  1,    set_sleep },
+	{ "i2c_khz",   &i2c_khz,    31, 400,  set_i2c_khz },
+	{ "i2c_retry", &i2c_retry,  0,  5,    i2c_set_retries },
+	{ "i2c_soft",  &i2c_soft,   I2C_SOFT_NONE, I2C_SOFT_SENSORS,
+		set_i2c_soft },
+	{ "sensors",   &sensors,    0,  SENSOR_ACC | SENSOR_GYRO | SENSOR_COMPASS,
+		set_sensors },
+	{ "telemetry", &telemetry,  TELEMETRY_OFF, TELEMETRY_BINARY,
+		set_telemetry },
+	{ "loglevel",  &log_level,  LOG_LEVEL_ERR, LOG_LEVEL_DEBUG, NULL },
+	{ "loop_ms",   &loop_ms,    0,  1000, NULL },
+	{ "filter",    &filter_type, FILTER_NONE, FILTER_BIQUAD, set_filter },
+	{ "decim",     &decimation, 1,  FILTER_MAX_DECIMATION, set_filter },
+	{ "stats_s",   &stats_s,    0,  3600, NULL },
+};
+
+static void cmd_stats(char *args)
+{
+	perf_report();
+	i2c_report();
+	stack_report();
+}
+
+static void cmd_latency(char *args)
+{
+	if (!strcmp_P(args, PSTR("reset")))
+		latency_reset();
+	else
+		latency_report();
+}
+
+static void print_angle(PGM_P name, const int16_t angle)
+{
+	const int16_t ddeg = angle_to_ddeg(angle);
+
+	printb("%" PRIpgm " %c%d.%d", name, ddeg < 0? '-': '+', abs(ddeg) / 10,
+			abs(ddeg) % 10);
+}
+
+static void cmd_attitude(char *args)
+{
+	struct attitude a;
+
+	fusion_get(&a);
+	print_angle(PSTR("roll"), a.roll);
+	print_angle(PSTR(" pitch"), a.pitch);
+	/* Heading as 0..360 */
+	printb(" heading %u\r\n", (uint16_t)(((uint32_t)a.heading * 360) >> 16));
+}
+
+#define ACC_CAL_SAMPLES 32
+
+/* Level and at rest: the offsets bring the mean to 0, 0, +1 g. An OFSx
+ * LSB is 15.6 mg, four data LSB */
+static void calibrate_acc(int8_t ofs[3])
+{
+	static const int8_t zero[3] = { 0, 0, 0 };
+	int32_t sum[3] = { 0, 0, -(int32_t)FUSION_ACC_1G * ACC_CAL_SAMPLES };
+	int16_t v[1][3];
+	uint8_t i, j;
+
+	set_acc_offset(zero);
+	/* Samples taken with the old offsets are still in the FIFO */
+	for (i = 0; i < ACC_CAL_SAMPLES &&
+			sensor_read(SENSOR_ID_ACC, v, 1); i++);
+	for (i = 0; i < ACC_CAL_SAMPLES; i++) {
+		mydelay_ms(1000 / acc_odr + 1);
+		sensor_read(SENSOR_ID_ACC, v, 1);
+		for (j = 0; j < 3; j++)
+			sum[j] += v[0][j];
+	}
+	for (j = 0; j < 3; j++) {
+		const int32_t o = -(sum[j] / ACC_CAL_SAMPLES);
+
+		ofs[j] = o > 4 * INT8_MAX? INT8_MAX: o < 4 * INT8_MIN? INT8_MIN:
+			(o + (o < 0? -2: 2)) / 4;
+	}
+	set_acc_offset(ofs);
+}
+
+static void apply_calibration(void)
+{
+	set_acc_offset(calib.acc_offset);
+	gyro_set_bias(calib.gyro_bias);
+	compass_set_calibration(calib.mag_offset, calib.mag_scale);
+}
+
+static void print_vector(PGM_P name, const int16_t v0,
+		const int16_t v1, const int16_t v2)
+{
+	printb("%" PRIpgm " %+hd %+hd %+hd\r\n", name, v0, v1, v2);
+}
 
-	init_display();
+/* Acc and gyro are read directly, without the sampler */
+static void cmd_calibrate(char *args)
+{
+	if (!strcmp_P(args, PSTR("acc"))) {
+		sampler_pause();
+		calibrate_acc(calib.acc_offset);
+		sampler_resume();
+	} else if (!strcmp_P(args, PSTR("gyro"))) {
+		if (!(sensors & SENSOR_GYRO)) {
+			printb("Gyro is off\r\n");
+			return;
+		}
+		sampler_pause();
+		if (!gyro_calibrate(calib.gyro_bias)) {
+			sampler_resume();
+			printb("Gyro not responding\r\n");
+			return;
+		}
+		sampler_resume();
+	} else if (!strcmp_P(args, PSTR("mag"))) {
+		compass_calibrate();
+		printb("Turn the board around every axis, then \"cal done\"\r\n");
+		return;
+	} else if (!strcmp_P(args, PSTR("done"))) {
+		if (!compass_calibrate_done(calib.mag_offset, calib.mag_scale)) {
+			printb("Not turned enough\r\n");
+			return;
+		}
+	} else if (!strcmp_P(args, PSTR("save"))) {
+		calib_save();
+	} else if (!strcmp_P(args, PSTR("clear"))) {
+		calib_reset();
+		apply_calibration();
+	} else if (*args) {
+		printb("Usage: cal [acc|gyro|mag|done|save|clear]\r\n");
+		return;
+	}
+
+	print_vector(PSTR("acc offset"), calib.acc_offset[0],
+			calib.acc_offset[1], calib.acc_offset[2]);
+	print_vector(PSTR("gyro bias"), calib.gyro_bias[0],
+			calib.gyro_bias[1], calib.gyro_bias[2]);
+	print_vector(PSTR("mag offset"), calib.mag_offset[0],
+			calib.mag_offset[1], calib.mag_offset[2]);
+	print_vector(PSTR("mag scale"), calib.mag_scale[0],
+			calib.mag_scale[1], calib.mag_scale[2]);
+}
+
+static void cmd_replay(char *args)
+{
+	replay_start();
+}
+
+static const struct shell_cmd cmds[] PROGMEM = {
+	{ "stats",  cmd_stats },
+	{ "lat",    cmd_latency },
+	{ "replay", cmd_replay },
+	{ "att",    cmd_attitude },
+	{ "cal",    cmd_calibrate },
+};
+
+/* Boot sequence, see boot.h */
+static bool calibrated;
+
+/* A calibrated compass has passed the self-test before, otherwise the
+ * test runs while the splash goes out. The sampler is not running yet,
+ * so the test reading can't be taken for a sample whichever sensors are
+ * enabled. */
+static bool boot_compass_test()
+{
+	if (!calibrated)
+		compass_test_start();
+	return true;
+}
+
+static bool boot_compass()
+{
+	if (!calibrated)
+		compass_test_check();
+	init_compass();
+	return true;
+}
+
+/* The calibration includes the OFSx registers. The motion engines are
+ * set up before measuring starts. */
+static bool boot_acc_config()
+{
+	set_acc_rate(acc_odr);
+	apply_calibration();
+	init_motion();
+	return true;
+}
+
+static bool boot_acc_measure()
+{
+	sensor_init(SENSOR_ID_ACC);
+	return true;
+}
+
+static const struct boot_step compass_steps[] PROGMEM = {
+	{ boot_compass_test, COMPASS_TEST_US },
+	{ boot_compass, 0 },
+};
+
+/* Measuring starts 1.1 ms after POWER_CTL, the first sample one period
+ * at the default 100 Hz later */
+static const struct boot_step acc_steps[] PROGMEM = {
+	{ boot_acc_config, 0 },
+	{ boot_acc_measure, 1100 + 10000 },
+};
+
+static const struct boot_step display_steps[] PROGMEM = {
+	{ init_display, 0 },
+	{ display_send, 0 },
+};
+
+static const struct boot_device boot_devices[] PROGMEM = {
+	{ "compass", compass_steps, 2 },
+	{ "acc",     acc_steps,     2 },
+	{ "display", display_steps, 2 },
+};
+_Static_assert(sizeof(boot_devices) / sizeof(boot_devices[0]) <=
+		BOOT_MAX_DEVICES, "boot_run() keeps BOOT_MAX_DEVICES states");
+
+void init() {
+	set_i2c_soft(i2c_soft);
+	calibrated = calib_load();
+	printb_P(calibrated? PSTR("Calibration loaded\r\n"):
+			PSTR("Not calibrated\r\n"));
+	boot_run(boot_devices, sizeof(boot_devices) / sizeof(boot_devices[0]));
 //	init_gyro();
-	init_acc();
-//	init_compass();
+	init_fusion(gyro_odr, sensor_scale(SENSOR_ID_GYRO));
+	sampler_set_interval(SENSOR_ID_GYRO, 1000000UL / gyro_odr);
+	set_filter(0);
+	latency_reset();
+	init_shell(params, sizeof(params) / sizeof(params[0]),
+			cmds, sizeof(cmds) / sizeof(cmds[0]));
 
 	DDRB |= 0x7;
 	PORTB |= 0x7;
+	init_sampler();
+}
+
+/* Latest filtered acceleration for the display: a sample coming before
+ * the previous one has been rendered replaces it. A spectrum only marks
+ * it full. */
+static struct {
+	int16_t v[3];
+	uint32_t t;   /* acquisition, clock_us() */
+	bool full;
+} display_mailbox;
+
+static int16_t gyro_last[3];
+static bool gyro_logged = true;
+
+_Static_assert(SPECTRUM_PEAKS == 3, "the Peaks line has three of them");
+
+/* Amplitude of a spectrum peak in mg */
+static uint16_t peak_mg(const struct spectrum_peak *p)
+{
+	return p->magnitude * sensor_scale(SENSOR_ID_ACC) /
+		(1000 * SPECTRUM_LSB);
+}
+
+/* Peaks of a new spectrum as amplitudes in mg */
+static void spectrum_log(void)
+{
+	const struct spectrum_peak *p;
+
+	spectrum_peaks(&p);
+	if (telemetry_mode == TELEMETRY_TEXT)
+		log_info("Peaks: %u Hz %u mg, %u Hz %u mg, %u Hz %u mg\r\n",
+				p[0].hz, peak_mg(&p[0]), p[1].hz, peak_mg(&p[1]),
+				p[2].hz, peak_mg(&p[2]));
+}
+
+/* A full block is analysed right away, the next one starts with the
+ * following sample, and the next frame draws it. A frame going out
+ * meanwhile takes its remaining pages from the new spectrum. */
+static void spectrum_ready(const uint32_t t)
+{
+	spectrum_analyse();
+	spectrum_log();
+	display_mailbox.t = t;
+	display_mailbox.full = true;
+}
+
+/* Processing stage: corrections, filters, fusion and telemetry of one
+ * sample. A replayed sample has been corrected before it was recorded. */
+static void process(const struct sample *smp, const bool replay)
+{
+	int16_t v[1][3];
+	double phi;
+
+	memcpy(v[0], smp->v, sizeof(v[0]));
+	switch (smp->id) {
+		case SENSOR_ID_GYRO:
+			if (!replay)
+				gyro_correct(v, 1);
+			fusion_gyro(v[0], 1);
+			if (telemetry_mode == TELEMETRY_BINARY)
+				telemetry_sample(TELEMETRY_GYRO, smp->t, v[0]);
+			memcpy(gyro_last, v[0], sizeof(gyro_last));
+			gyro_logged = false;
+			break;
+
+		case SENSOR_ID_COMPASS:
+			if (!replay)
+				compass_correct(v[0]);
+			if (!filter_push(&compass_filter, v[0], v[0]))
+				break;
+			fusion_compass(v[0]);
+			if (telemetry_mode == TELEMETRY_BINARY)
+				telemetry_sample(TELEMETRY_COMPASS, smp->t, v[0]);
+			else if (telemetry_mode == TELEMETRY_TEXT)
+				log_info("Comp: %+6hd %+6hd %+6hd\r\n",
+						v[0][0], v[0][1], v[0][2]);
+			break;
+
+		case SENSOR_ID_ACC: {
+			static bool first = true;
+
+			if (first) {
+				first = false;
+				printb("First sample at %" PRIu32 " us\r\n", smp->t);
+			}
+			/* Raw samples, the filter would decimate them */
+			if (display_mode == DISPLAY_SPECTRUM &&
+					spectrum_push(v[0][fft_axis]))
+				spectrum_ready(replay? clock_us(): smp->t);
+			if (!filter_push(&acc_filter, v[0], v[0]))
+				break;
+			fusion_acc(v[0]);
+			if (telemetry_mode == TELEMETRY_BINARY)
+				telemetry_sample(TELEMETRY_ACC, smp->t, v[0]);
+			/* The spectrum replaces the tilt on the UART and the display */
+			if (display_mode == DISPLAY_SPECTRUM)
+				break;
+//			printb("Accl: %+6hd %+6hd %+6hd %f.\r\n", v[0], v[1], v[2],
+//					atan2(v[1], v[2])*180/3.14159);
+			phi = atan2(v[0][1], v[0][2]);
+			if (telemetry_mode == TELEMETRY_TEXT)
+				log_info("Accl: %+5.1f \r\n", phi*180/3.14159);
+
+			memcpy(display_mailbox.v, v[0], sizeof(display_mailbox.v));
+			display_mailbox.t = replay? clock_us(): smp->t;
+			display_mailbox.full = true;
+			break;
+		}
+	}
+}
+
+/* What the frame going out shows, taken as it starts, as its pages are
+ * drawn one by one while it goes out. The splash until the first one. */
+static struct {
+	uint8_t mode;
+	union {
+		int16_t v[3];       /* DISPLAY_HORIZON */
+		struct fix_mat3 r;  /* the models */
+	};
+	bool splash;
+} frame = { .splash = true };
+
+static void frame_start(const int16_t v[3])
+{
+	struct attitude a;
+
+	frame.mode = display_mode;
+	frame.splash = false;
+	if (frame.mode == DISPLAY_HORIZON) {
+		memcpy(frame.v, v, sizeof(frame.v));
+	} else if (frame.mode != DISPLAY_SPECTRUM) {
+		fusion_get(&a);
+		fix_rotation(&frame.r, a.roll, a.pitch, a.heading);
+	}
+}
+
+/* The horizon from the acceleration alone, 64 tan(atan2(y, z)) being
+ * 64 y / z, a model from the fused attitude or the last spectrum. No
+ * floating point. */
+static void render(const uint8_t page)
+{
+	gfx_set_band(page, 1);
+	if (frame.splash) {
+		gfx_blit_P(band, header_data);
+		return;
+	}
+	gfx_clear(band);
+	if (frame.mode == DISPLAY_SPECTRUM) {
+		spectrum_draw(band);
+		return;
+	}
+	if (frame.mode == DISPLAY_HORIZON) {
+		const int32_t d = frame.v[2];
+		int32_t n = -64L * frame.v[1];
+
+		if (!d)
+			return;
+		/* Rounded half away from zero */
+		n += (n < 0) == (d < 0)? d / 2: -d / 2;
+		n /= d;
+		line(band, 0, 32 + n, 127, 32 - n);
+		return;
+	}
+
+	wire3d_draw(band, frame.mode == DISPLAY_CUBE? &wire3d_cube:
+			&wire3d_aircraft, &frame.r);
+}
+
+/* Render and transport stages: once the previous frame is out and the
+ * next one is due, takes whatever the mailbox holds, then draws and sends
+ * a chunk per call. Frames falling due while one goes out are skipped
+ * rather than queued, as they would be stale by the time the bus is free.
+ * @return true while a frame is going out */
+static bool display_update(const uint32_t now)
+{
+	static uint32_t last_frame = 0, acquired;
+	static bool sending = false;
+	const uint32_t period = 1000000UL / display_hz;
+
+	if (!sending) {
+		if (!display_mailbox.full || now - last_frame < period)
+			return false;
+
+		last_frame = now;
+		acquired = display_mailbox.t;
+		display_mailbox.full = false;
+		frame_start(display_mailbox.v);
+		sending = true;
+	}
+
+	/* The last chunk is still going out on the bit-banged bus */
+	if (i2c_busy(DISPLAY_ADDR))
+		return true;
+	sending = !display_send();
+	sampler_kick();
+	if (sending)
+		return true;
+
+	PERF_INC(frames);
+	if (clock_us() - last_frame >= 2 * period)
+		PERF_ADD(frames_skipped, (clock_us() - last_frame) / period - 1);
+	latency_record(clock_us() - acquired);
+	return false;
+}
+
+static const char motion_names[][11] PROGMEM = {
+	"free fall", "inactivity", "activity", "double tap", "tap"
+};
+
+/* Events on the UART, the ADXL345 decides when to rest */
+static void motion_update(void)
+{
+	const uint8_t events = motion_poll();
+	uint8_t i;
+
+	if (telemetry_mode == TELEMETRY_TEXT)
+		for (i = 0; i < sizeof(motion_names) / sizeof(motion_names[0]); i++)
+			if (events & (MOTION_FREE_FALL << i))
+				log_info("Motion: %" PRIpgm "\r\n", motion_names[i]);
+
+	if (events & MOTION_INACTIVITY && sleep_on)
+		rest(true);
+	if (events & MOTION_ACTIVITY)
+		rest(false);
+}
+
+/* Idle mode keeps Timer1, the UART and INT0 going: the clock, the shell
+ * and the ADXL345 wake the CPU. An edge on INT0 after the check still
+ * wakes it, interrupts come back on with the instruction after sei. */
+static void idle(void)
+{
+	PERF_START(t_sleep);
+	set_sleep_mode(SLEEP_MODE_IDLE);
+	cli();
+	if (!motion_pending()) {
+		sleep_enable();
+		sei();
+		sleep_cpu();
+		sleep_disable();
+	}
+	sei();
+	PERF_STOP(sleep, t_sleep);
 }
 
 int main()
@@ -297,28 +857,54 @@ int main()
 	hw_init();
 	init();
 
-	mydelay_ms(100);
 	while(1) {
-		int16_t v[3];
-		double phi;
-//		read_gyro(v);
-//		printb("Gyro: %+6hd %+6hd %+6hd\r\n", v[0], v[1], v[2]);
-//		read_compass(v);
-//		printb("Comp: %+6hd %+6hd %+6hd\r\n", v[0], v[1], v[2]);
-		read_acc(v);
-//		printb("Accl: %+6hd %+6hd %+6hd %f.\r\n", v[0], v[1], v[2],
-//				atan2(v[1], v[2])*180/3.14159);
-		phi = atan2(v[1], v[2]);
-		printb("Accl: %+5.1f \r\n", phi*180/3.14159);
-
-		memset(s.b, 0, sizeof(s));
-		if (v[2]) {
-			const long dy = -lround(64.0*tan(phi));
-			line(s.b, 0, 32+dy, 127, 32-dy);
+		static uint32_t last_stats = 0;
+		const bool replay = replay_active();
+		uint32_t now = clock_us();
+		struct sample smp;
+
+		/* A recorded sample stands in for the sampler */
+		sampler_set_sensors(replay? 0: sensors);
+		if (replay) {
+			const uint8_t type = replay_sample(&now, smp.v);
+
+			if (type) {
+				smp.t = now;
+				smp.id = type - 1;
+				process(&smp, true);
+			}
+		} else {
+			while (sampler_get(&smp))
+				process(&smp, false);
+		}
+		/* The newest of the gyro samples processed */
+		if (!gyro_logged && telemetry_mode == TELEMETRY_TEXT)
+			log_info("Gyro: %+6hd %+6hd %+6hd\r\n",
+					gyro_last[0], gyro_last[1], gyro_last[2]);
+		gyro_logged = true;
+
+		if (stats_s && now - last_stats >= stats_s * 1000000UL) {
+			/* Whole, as the reply of "stats" */
+			const enum UART_OVERFLOW_POLICY policy =
+				uart_set_overflow_policy(UART_OVF_BLOCK);
+
+			last_stats = now;
+			perf_report();
+			uart_set_overflow_policy(policy);
 		}
 
-		dump_buffer(&s);
-		mydelay_ms(10);
+		if (!replay)
+			shell_poll();
+		log_flush();
+		i2c_flush_errors();
+		i2c_trace_flush();
+		motion_update();
+		PERF_LOOP();
+		/* Sleeps between frames only, a frame goes out at bus speed */
+		if (resting && !replay)
+			idle();
+		else if (!display_update(clock_us()))
+			mydelay_ms(loop_ms);
 	}
 
 	/* Not reachable */
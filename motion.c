@@ -0,0 +1,96 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+
+#include "motion.h"
+#include "sensor.h"
+#include "i2c.h"
+#include "sampler.h"
+
+#define BIT(n) (1 << (n))
+
+#define ADXL345_TIME_INACT 0x26
+#define ADXL345_INT_SOURCE 0x30
+
+#define MOTION_EVENTS (MOTION_FREE_FALL | MOTION_INACTIVITY | \
+		MOTION_ACTIVITY | MOTION_DOUBLE_TAP | MOTION_TAP)
+
+/* Thresholds in 62.5 mg, DUR in 625 us, Latent and Window in 1.25 ms,
+ * TIME_FF in 5 ms. Activity and inactivity are ac-coupled: they compare
+ * against the sample taken when they were armed, so gravity and the
+ * board's tilt don't count. */
+static const struct sensor_reg motion_init[] PROGMEM = {
+	{ 0x1d, 0x30 },  /* THRESH_TAP: 3 g */
+	{ 0x21, 0x20 },  /* DUR: 20 ms */
+	{ 0x22, 0x50 },  /* Latent: 100 ms */
+	{ 0x23, 0xc8 },  /* Window: 250 ms */
+	{ 0x24, 0x04 },  /* THRESH_ACT: 250 mg */
+	{ 0x25, 0x02 },  /* THRESH_INACT: 125 mg */
+	{ ADXL345_TIME_INACT, MOTION_INACTIVITY_S },
+	{ 0x27, 0xff },  /* ACT_INACT_CTL: ac, all axes */
+	{ 0x28, 0x07 },  /* THRESH_FF: 437 mg */
+	{ 0x29, 0x14 },  /* TIME_FF: 100 ms */
+	{ 0x2a, 0x07 },  /* TAP_AXES: x, y, z */
+	{ 0x2f, 0x00 },  /* INT_MAP: all on INT1 */
+	{ 0x2e, MOTION_EVENTS },  /* INT_ENABLE */
+};
+
+/* INT1 may be high from before the reset, which makes no edge */
+static volatile bool pending = true;
+
+ISR(INT0_vect)
+{
+	pending = true;
+}
+
+void init_motion(void)
+{
+	struct sensor_reg r;
+	uint8_t i;
+
+	for (i = 0; i < sizeof(motion_init) / sizeof(motion_init[0]); i++) {
+		memcpy_P(&r, &motion_init[i], sizeof(r));
+		sensor_write(SENSOR_ID_ACC, r.reg, 1, &r.value);
+	}
+
+	/* INT1 is push-pull, active high: PD2 an input without pull-up,
+	 * INT0 on the rising edge */
+	DDRD &= ~BIT(PD2);
+	PORTD &= ~BIT(PD2);
+	EICRA |= BIT(ISC01) | BIT(ISC00);
+	EIFR = BIT(INTF0);
+	EIMSK |= BIT(INT0);
+}
+
+void motion_set_inactivity(const uint16_t s)
+{
+	const uint8_t t = s;
+
+	sensor_write(SENSOR_ID_ACC, ADXL345_TIME_INACT, 1, &t);
+}
+
+bool motion_pending(void)
+{
+	return pending;
+}
+
+/* Another edge coming while INT_SOURCE is read sets pending again, the
+ * next call then finds nothing or the new events */
+uint8_t motion_poll(void)
+{
+	uint8_t source = 0;
+
+	if (!pending)
+		return 0;
+	pending = false;
+	if (!i2c_read_regs(sensor_address(SENSOR_ID_ACC), ADXL345_INT_SOURCE,
+				1, &source))
+		pending = true;
+	sampler_kick();
+
+	return source & MOTION_EVENTS;
+}
@@ -0,0 +1,43 @@
+#ifndef _MOTION_H
+#define _MOTION_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/** Motion events from the detection engines of the ADXL345.
+ *
+ *  The chip itself watches its samples for taps, activity, inactivity and
+ *  free fall, and raises INT1, wired to INT0 (PD2). The ISR only takes
+ *  note: motion_poll() reads INT_SOURCE from the main loop, which clears
+ *  the events latched there and the pin. Activity and inactivity are
+ *  linked (see sensor.c), each one arms the other, so a board coming to
+ *  rest reports MOTION_INACTIVITY once and MOTION_ACTIVITY once when it
+ *  moves again. Nothing is polled in between.
+ */
+
+/* As in INT_SOURCE */
+enum MOTION_EVENT {
+	MOTION_FREE_FALL  = 1 << 2,
+	MOTION_INACTIVITY = 1 << 3,
+	MOTION_ACTIVITY   = 1 << 4,
+	MOTION_DOUBLE_TAP = 1 << 5,
+	MOTION_TAP        = 1 << 6
+};
+
+/* Default time at rest before MOTION_INACTIVITY */
+#define MOTION_INACTIVITY_S 5
+
+/** Sets up the engines before the ADXL345 measures, and INT0 */
+void init_motion(void);
+
+/** @param s time at rest before MOTION_INACTIVITY, 1 to 255 */
+void motion_set_inactivity(const uint16_t s);
+
+/** @return true if INT1 has risen since the last motion_poll() */
+bool motion_pending(void);
+
+/** @return MOTION_... events since the last call, none without an
+ *  interrupt in between */
+uint8_t motion_poll(void);
+
+#endif /* _MOTION_H */
@@ -0,0 +1,101 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <util/atomic.h>
+
+#include "perf.h"
+#include "clock.h"
+#include "uart.h"
+#include "log.h"
+
+#ifdef PERF_COUNTERS
+
+struct perf_counters perf;
+
+static uint32_t perf_window_start = 0; /* clock_us() */
+static uint32_t perf_last_loop = 0;
+
+/* Transactions on the two buses may end at the same time, one of them
+ * in the sampler ISR */
+void perf_i2c(const uint8_t address, const uint16_t bytes)
+{
+	struct perf_i2c *d = perf.i2c;
+
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		/* The last slot takes whatever doesn't fit */
+		while (d < &perf.i2c[PERF_I2C_DEVICES - 1] &&
+				d->transactions && d->address != address)
+			d++;
+
+		d->address = address;
+		d->transactions++;
+		d->bytes += bytes;
+	}
+}
+
+void perf_loop(void)
+{
+	const uint32_t now = clock_ticks();
+	const uint32_t period = now - perf_last_loop;
+
+	if (perf.loops && period > perf.loop_max)
+		perf.loop_max = period;
+	perf_last_loop = now;
+	perf.loops++;
+}
+
+static uint32_t to_us(const uint32_t ticks)
+{
+	return ticks / CLOCK_TICKS_PER_US;
+}
+
+void perf_report(void)
+{
+	const uint32_t now = clock_us();
+	const uint32_t window = now - perf_window_start;
+	const uint16_t frames = perf.frames? perf.frames: 1;
+	const uint16_t updates = perf.fusion_updates? perf.fusion_updates: 1;
+	const uint16_t spectra = perf.spectra? perf.spectra: 1;
+	uint32_t samples, ticks, wait;
+	uint16_t overruns, busy;
+	uint8_t i;
+
+	/* Counted in the sampler ISR as well */
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		samples = perf.sensor_samples;
+		overruns = perf.fifo_overruns;
+		ticks = perf.sampler_ticks;
+		busy = perf.sampler_busy;
+		wait = perf.i2c_wait;
+	}
+
+	printb("stats over %" PRIu32 " ms\r\n", window / 1000);
+	printb("loop: %" PRIu32 "/s, max %" PRIu32 " us\r\n",
+			perf.loops * 100 / (window / 10000 + 1),
+			to_us(perf.loop_max));
+	printb("sleep: %" PRIu32 " us\r\n", to_us(perf.sleep));
+	printb("frame: %u, %u skipped, render %" PRIu32 " us, flush %" PRIu32
+			" us\r\n", perf.frames, perf.frames_skipped,
+			to_us(perf.render / frames), to_us(perf.flush / frames));
+	printb("fusion: %u updates, %" PRIu32 " us\r\n", perf.fusion_updates,
+			to_us(perf.fusion / updates));
+	printb("spectrum: %u blocks, %" PRIu32 " us\r\n", perf.spectra,
+			to_us(perf.spectrum / spectra));
+	printb("sensors: %" PRIu32 " samples, %u FIFO overruns\r\n", samples,
+			overruns);
+	printb("sampler: %" PRIu32 " ticks, %u on a busy bus\r\n", ticks, busy);
+	printb("i2c wait: %" PRIu32 " us\r\n", to_us(wait));
+	for (i = 0; i < PERF_I2C_DEVICES && perf.i2c[i].transactions; i++)
+		printb("i2c %#02x: %u xfers, %" PRIu32 " B\r\n",
+				perf.i2c[i].address,
+				perf.i2c[i].transactions, perf.i2c[i].bytes);
+	printb("uart: %" PRIu32 " B queued, %u dropped, log %u dropped\r\n",
+			perf.uart_queued, uart_dropped(), log_dropped());
+
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+		memset(&perf, 0, sizeof(perf));
+	perf_window_start = now;
+}
+
+#endif /* PERF_COUNTERS */
@@ -0,0 +1,84 @@
+#ifndef _PERF_H
+#define _PERF_H
+
+#include <stdint.h>
+
+/** Hot path performance counters.
+ *
+ *  Enabled with PERF_COUNTERS, otherwise every hook compiles to nothing.
+ *  Times are in clock ticks, see clock.h. Counters cover the window since
+ *  the previous perf_report(). The sampler ISR and the main loop count
+ *  into the same ones, so the hooks update them with interrupts off.
+ */
+
+#ifdef PERF_COUNTERS
+
+#include <util/atomic.h>
+
+#include "clock.h"
+
+#define PERF_I2C_DEVICES 4
+
+struct perf_i2c {
+	uint8_t address;
+	uint16_t transactions;
+	uint32_t bytes;
+};
+
+struct perf_counters {
+	struct perf_i2c i2c[PERF_I2C_DEVICES];
+	uint32_t i2c_wait;
+	uint32_t render, flush;
+	uint32_t fusion;
+	uint16_t fusion_updates;
+	uint32_t spectrum;
+	uint16_t spectra;
+	uint32_t sensor_samples;
+	uint16_t fifo_overruns;
+	uint16_t frames, frames_skipped;
+	uint32_t sampler_ticks;
+	uint16_t sampler_busy;
+	uint32_t uart_queued;
+	uint32_t loops;
+	uint32_t loop_max;
+	uint32_t sleep;
+};
+
+extern struct perf_counters perf;
+
+void perf_i2c(const uint8_t address, const uint16_t bytes);
+/** Marks a main loop iteration */
+void perf_loop(void);
+/** Prints the counters and starts a new window */
+void perf_report(void);
+
+#define PERF_INC(counter)       PERF_ADD(counter, 1)
+#define PERF_ADD(counter, n) \
+	do { \
+		ATOMIC_BLOCK(ATOMIC_RESTORESTATE) \
+			perf.counter += (n); \
+	} while (0)
+#define PERF_I2C(address, n)    perf_i2c(address, n)
+#define PERF_LOOP()             perf_loop()
+/* Short sections, up to 32 ms */
+#define PERF_START16(t)         const uint16_t t = clock_ticks16()
+#define PERF_STOP16(counter, t) PERF_ADD(counter, (uint16_t)(clock_ticks16() - (t)))
+#define PERF_START(t)           const uint32_t t = clock_ticks()
+#define PERF_STOP(counter, t)   PERF_ADD(counter, clock_ticks() - (t))
+
+#else
+
+#define PERF_INC(counter)       ((void)0)
+#define PERF_ADD(counter, n)    ((void)0)
+#define PERF_I2C(address, n)    ((void)0)
+#define PERF_LOOP()             ((void)0)
+#define PERF_START16(t)         do {} while (0)
+#define PERF_STOP16(counter, t) ((void)0)
+#define PERF_START(t)           do {} while (0)
+#define PERF_STOP(counter, t)   ((void)0)
+
+static inline void perf_report(void) {}
+
+#endif /* PERF_COUNTERS */
+
+#endif /* _PERF_H */
@@ -0,0 +1,115 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "replay.h"
+#include "telemetry.h"
+#include "frame.h"
+#include "uart.h"
+#include "clock.h"
+
+/* Asks again when nothing has come for that long, a packet takes 3.5 ms */
+#define REPLAY_TIMEOUT_US 100000UL
+
+/* A frame arrives in 3.5 ms at 115200, the main loop may be sleeping for
+ * longer: the RX ring takes it whole, with its COBS code, CRC and both
+ * delimiters */
+_Static_assert(UART_RX_SIZE >= sizeof(struct telemetry_replay) + 5,
+		"a replayed packet doesn't fit into the RX ring");
+
+/* Decoded in place, only while waiting: the samples of a packet are taken
+ * before the next one is asked for */
+static union {
+	struct telemetry_replay r;
+	uint8_t b[sizeof(struct telemetry_replay) + 2]; /* and the CRC */
+} rx;
+static const struct telemetry_packet *const packet = &rx.r.p;
+static uint8_t next, count;
+static uint8_t seq;  /* of the packet wanted */
+static uint32_t asked;
+static struct frame_decoder decoder;
+static bool active, waiting;
+
+static void replay_request(void)
+{
+	const uint8_t ready[2] = { TELEMETRY_REPLAY_READY, seq };
+
+	frame_send(uart_put, ready, sizeof(ready));
+	asked = clock_us();
+	waiting = true;
+}
+
+static bool replay_packet(const int len)
+{
+	const struct telemetry_header *h = &packet->h;
+
+	if (len < (int)sizeof(rx.r.seq) + (int)sizeof(*h) || rx.r.seq != seq ||
+			!h->type || h->type > TELEMETRY_SENSORS ||
+			!h->count || h->count > TELEMETRY_BATCH ||
+			len != (int)(sizeof(rx.r.seq) + sizeof(*h) +
+				h->count * sizeof(packet->v[0])))
+		return false;
+
+	seq++;
+	count = h->count;
+	next = 0;
+	return true;
+}
+
+void replay_start(void)
+{
+	frame_decoder_init(&decoder, rx.b, sizeof(rx.b));
+	count = next = 0;
+	seq = 0;
+	waiting = false;
+	active = true;
+}
+
+bool replay_active(void)
+{
+	return active;
+}
+
+uint8_t replay_sample(uint32_t *t_us, int16_t v[3])
+{
+	const struct telemetry_header *h = &packet->h;
+	int c;
+
+	if (!active)
+		return 0;
+
+	if (next >= count) {
+		if (!waiting)
+			replay_request();
+
+		while ((c = uart_getc()) >= 0) {
+			const int len = frame_decode(&decoder, c);
+
+			if (len == 1 && rx.b[0] == TELEMETRY_REPLAY_END) {
+				active = false;
+				return 0;
+			}
+			if (len > 0 && replay_packet(len)) {
+				waiting = false;
+				break;
+			}
+			/* Lost bytes, ask again rather than wait forever. A
+			 * packet sent again after we had it is only dropped, the
+			 * request for the next one is out already. */
+			if (len < 0)
+				replay_request();
+		}
+		/* The request or the packet got lost on the way */
+		if (waiting && clock_us() - asked > REPLAY_TIMEOUT_US)
+			replay_request();
+		if (next >= count)
+			return 0;
+	}
+
+	*t_us = h->t_first;
+	if (h->count > 1)
+		*t_us += (h->t_last - h->t_first) * next / (h->count - 1);
+	memcpy(v, packet->v[next++], sizeof(packet->v[0]));
+
+	return h->type;
+}
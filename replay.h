@@ -0,0 +1,32 @@
+#ifndef _REPLAY_H
+#define _REPLAY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/** Sensor replay.
+ *
+ *  Feeds samples of a binary telemetry capture (see telemetry.h) to the
+ *  main loop instead of the I2C readers, with their recorded timestamps.
+ *  tools/telemetry_replay streams the capture back over the UART, one
+ *  packet per TELEMETRY_REPLAY_READY frame sent from here, and ends with
+ *  TELEMETRY_REPLAY_END. Packets are numbered (see struct
+ *  telemetry_replay): a corrupt one is asked for again by number, and a
+ *  repeat of one already taken is dropped, so nothing is skipped or
+ *  replayed twice. The receiver owns the UART input meanwhile, whose RX
+ *  ring holds a whole frame.
+ *  The loop runs as fast as the link allows, set loop_ms to 0 to run
+ *  faster than real time.
+ */
+
+/** Takes over the UART input until the end of the capture */
+void replay_start(void);
+
+bool replay_active(void);
+
+/** Pops the next recorded sample, asking for more data once they are used
+ *  @return sensor type (see enum TELEMETRY_TYPE), 0 if none is ready yet
+ */
+uint8_t replay_sample(uint32_t *t_us, int16_t v[3]);
+
+#endif /* _REPLAY_H */
@@ -0,0 +1,140 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+
+#include "sampler.h"
+#include "sensor.h"
+#include "clock.h"
+#include "perf.h"
+
+#define BIT(n) (1 << (n))
+
+/* Timer2 in CTC mode at clk/64 */
+#define SAMPLER_OCR (F_CPU / 64 / SAMPLER_HZ - 1)
+_Static_assert(SAMPLER_OCR > 0 && SAMPLER_OCR < 256,
+		"SAMPLER_HZ out of the Timer2 range");
+
+/* FIFO samples per poll at most, the chip holds the rest */
+#define SAMPLER_BURST 8
+
+#define SAMPLER_QUEUE_MASK (SAMPLER_QUEUE_SIZE - 1)
+_Static_assert(!(SAMPLER_QUEUE_SIZE & SAMPLER_QUEUE_MASK) &&
+		SAMPLER_QUEUE_SIZE <= 128,
+		"SAMPLER_QUEUE_SIZE must be a power of two up to 128");
+
+/* Free-running indices as in the UART rings: head is written by the ISR
+ * only, tail by sampler_get() only. The sensors read straight into
+ * values, hence a column per field rather than an array of samples. */
+static int16_t values[SAMPLER_QUEUE_SIZE][3];
+static uint32_t stamps[SAMPLER_QUEUE_SIZE];
+static uint8_t ids[SAMPLER_QUEUE_SIZE];
+static volatile uint8_t head = 0, tail = 0;
+
+static volatile uint8_t sensors = 0;
+/* A tick has found the bus busy */
+static volatile bool starved = false;
+static uint16_t interval[SENSOR_COUNT];
+
+void init_sampler(void)
+{
+	TCCR2A = BIT(WGM21);
+	TCCR2B = BIT(CS22); /* clk/64 */
+	OCR2A = SAMPLER_OCR;
+	TCNT2 = 0;
+	TIFR2 = BIT(OCF2A);
+	TIMSK2 = BIT(OCIE2A);
+}
+
+void sampler_set_sensors(const uint8_t mask)
+{
+	sensors = mask;
+}
+
+void sampler_set_interval(const uint8_t id, const uint16_t us)
+{
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+		interval[id] = us;
+}
+
+void sampler_pause(void)
+{
+	TIMSK2 &= ~BIT(OCIE2A);
+}
+
+void sampler_resume(void)
+{
+	TIMSK2 |= BIT(OCIE2A);
+}
+
+/* Two timer clocks to the match, the one after a TCNT2 write never
+ * matches. Waiting for the count to wrap keeps the caller off the bus
+ * until the tick has run. */
+void sampler_kick(void)
+{
+	if (!starved)
+		return;
+	TCNT2 = SAMPLER_OCR - 1;
+	while (TCNT2 == SAMPLER_OCR - 1 || TCNT2 == SAMPLER_OCR);
+}
+
+bool sampler_get(struct sample *s)
+{
+	const uint8_t t = tail, i = t & SAMPLER_QUEUE_MASK;
+
+	if (t == head)
+		return false;
+	s->t = stamps[i];
+	memcpy(s->v, values[i], sizeof(s->v));
+	s->id = ids[i];
+	tail = t + 1;
+	return true;
+}
+
+/* Straight into the queue, in the order of the sensor schedule */
+static void sampler_poll(void)
+{
+	const uint32_t now = clock_us();
+	const uint8_t h = head;
+	struct sensor_buf buf = {
+		values, ids, SAMPLER_QUEUE_MASK, h,
+		SAMPLER_QUEUE_SIZE - (uint8_t)(h - tail), SAMPLER_BURST
+	};
+	uint8_t n[SENSOR_COUNT] = { 0 };
+	uint8_t i;
+
+	if (!sensor_poll(sensors, now, &buf))
+		return;
+
+	/* The last sample of a sensor is stamped now */
+	for (i = h; i != buf.head; i++)
+		n[ids[i & SAMPLER_QUEUE_MASK]]++;
+	for (i = h; i != buf.head; i++) {
+		const uint8_t id = ids[i & SAMPLER_QUEUE_MASK];
+
+		stamps[i & SAMPLER_QUEUE_MASK] =
+			now - (uint32_t)--n[id] * interval[id];
+	}
+	head = buf.head;
+}
+
+ISR(TIMER2_COMPA_vect)
+{
+	/* Lets the UART and the clock in while the bus transfers, but not
+	 * this vector again */
+	TIMSK2 &= ~BIT(OCIE2A);
+	sei();
+
+	PERF_INC(sampler_ticks);
+	starved = sensor_busy(sensors);
+	if (starved)
+		PERF_INC(sampler_busy);
+	else
+		sampler_poll();
+
+	cli();
+	TIMSK2 |= BIT(OCIE2A);
+}
@@ -0,0 +1,51 @@
+#ifndef _SAMPLER_H
+#define _SAMPLER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/** Sensor acquisition in interrupt context.
+ *
+ *  Timer2 ticks at SAMPLER_HZ and its ISR polls the enabled sensors (see
+ *  sensor_poll()), queueing every sample with its timestamp for the main
+ *  loop. The ISR lets other interrupts in while the bus transfers, and
+ *  skips the tick if it has interrupted a transaction of the main loop
+ *  on the bus of the sensors, which therefore keeps its own ones short
+ *  and calls sampler_kick() after them. Nothing is read that the queue
+ *  has no room for: a FIFO keeps the rest, a sensor without one is read
+ *  late.
+ *  The queue is kept short for the RAM's sake, the FIFOs of the chips
+ *  hold the backlog while the main loop is busy.
+ */
+
+#define SAMPLER_HZ 1000
+#define SAMPLER_QUEUE_SIZE 16
+
+struct sample {
+	uint32_t t;   /* clock_us() */
+	int16_t v[3];
+	uint8_t id;   /* enum SENSOR_ID */
+};
+
+/** Takes over Timer2, polling nothing until sampler_set_sensors() */
+void init_sampler(void);
+
+/** @param mask BIT(SENSOR_ID_...) of the sensors to poll */
+void sampler_set_sensors(const uint8_t mask);
+
+/** Time between the samples of a FIFO, the last one of a burst is
+ *  stamped with the poll time and the others back-dated */
+void sampler_set_interval(const uint8_t id, const uint16_t us);
+
+/** Stops polling, e.g. for a calibration reading a sensor directly */
+void sampler_pause(void);
+void sampler_resume(void);
+
+/** Runs the next tick right away if the last one found the bus busy,
+ *  returns once it has */
+void sampler_kick(void);
+
+/** @return false if the queue is empty */
+bool sampler_get(struct sample *s);
+
+#endif /* _SAMPLER_H */
@@ -0,0 +1,249 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <avr/pgmspace.h>
+#include <util/atomic.h>
+
+#include "sensor.h"
+#include "i2c.h"
+#include "clock.h"
+#include "perf.h"
+
+#define BIT(x) (1 << (x))
+
+/* ADXL345: +-2 g at 3.9 mg/LSB, measuring, the FIFO streaming. BW_RATE
+ * and OFSx are set at runtime and left alone, and so are the motion
+ * engines, see motion.c. */
+static const struct sensor_reg acc_init[] PROGMEM = {
+	{ 0x38, 0x80 },  /* FIFO_CTL: stream */
+	{ 0x2d, 0x28 },  /* POWER_CTL: link activity and inactivity, measure */
+};
+
+/* L3G4200D: 100 Hz, all axes, 250 deg/s at 8.75 mdps/LSB with block data
+ * update. Passing the FIFO through bypass mode restarts it empty, then it
+ * streams. The ODR is changed at runtime. */
+static const struct sensor_reg gyro_init[] PROGMEM = {
+	{ 0x20, 0x0f },  /* CTRL_REG1 */
+	{ 0x23, 0x80 },  /* CTRL_REG4 */
+	{ 0x2e, 0x00 },  /* FIFO_CTRL: bypass */
+	{ 0x24, 0x40 },  /* CTRL_REG5: FIFO_EN */
+	{ 0x2e, 0x40 },  /* FIFO_CTRL: stream */
+};
+
+/* HMC5883L: 75 Hz continuous, +-4.7 G at 390 LSB/G */
+static const struct sensor_reg compass_init[] PROGMEM = {
+	{ 0x00, 0x18 },  /* CRA */
+	{ 0x01, 0xa0 },  /* CRB */
+	{ 0x02, 0x00 },  /* MODE: continuous */
+};
+
+static const struct sensor_desc sensors[SENSOR_COUNT] PROGMEM = {
+	[SENSOR_ID_ACC] = {
+		.address = 0x53,
+		.flags = SENSOR_FIFO | SENSOR_FIFO_SINGLE,
+		.init = acc_init, .n_init = 2,
+		.data = 0x32, .axes = { 0, 1, 2 },
+		.scale = 3900,
+		.period_us = 1000000UL / 100,
+		/* FIFO_STATUS: entries, 32 of them most likely with some lost */
+		.fifo_level = 0x39, .fifo_mask = 0x3f, .fifo_full = BIT(5),
+		.fifo_size = 32,
+	},
+	[SENSOR_ID_GYRO] = {
+		.address = 0x69,
+		.flags = SENSOR_AUTOINC_MSB | SENSOR_FIFO,
+		.init = gyro_init, .n_init = 5,
+		.data = 0x28, .axes = { 0, 1, 2 },
+		.scale = 8750,
+		/* A quarter of the FIFO at 800 Hz */
+		.period_us = 10000,
+		/* FIFO_SRC: FSS, OVRN */
+		.fifo_level = 0x2f, .fifo_mask = 0x1f, .fifo_full = BIT(6),
+		.fifo_size = 32,
+	},
+	[SENSOR_ID_COMPASS] = {
+		.address = 0x1e,
+		.flags = SENSOR_BIG_ENDIAN,
+		.init = compass_init, .n_init = 3,
+		/* The pointer wraps from the last data register to the first */
+		.data = 0x03, .axes = { 0, 2, 1 },
+		.scale = 2564,
+		.period_us = 1000000UL / 75,
+	},
+};
+
+/* Order of the bursts in a poll, which is also who gets the room first:
+ * acc, compass, then the gyro with the deepest FIFO */
+static const uint8_t schedule[SENSOR_COUNT] PROGMEM = {
+	SENSOR_ID_ACC, SENSOR_ID_COMPASS, SENSOR_ID_GYRO
+};
+
+/* Shared with an ISR polling the sensors, updated atomically. A period
+ * of 0 is the descriptor's. */
+static uint32_t next[SENSOR_COUNT];
+static uint16_t period[SENSOR_COUNT];
+static uint16_t overruns[SENSOR_COUNT];
+
+static void sensor_desc(const uint8_t id, struct sensor_desc *d)
+{
+	memcpy_P(d, &sensors[id], sizeof(*d));
+}
+
+void sensor_init(const uint8_t id)
+{
+	struct sensor_desc d;
+	struct sensor_reg r;
+	uint8_t i;
+
+	sensor_desc(id, &d);
+	for (i = 0; i < d.n_init; i++) {
+		memcpy_P(&r, &d.init[i], sizeof(r));
+		i2c_write_regs(d.address, r.reg, 1, &r.value);
+	}
+	sensor_defer(id, 0);
+}
+
+void sensor_write(const uint8_t id, const uint8_t reg, const uint8_t N,
+		const uint8_t bytes[N])
+{
+	i2c_write_regs(pgm_read_byte(&sensors[id].address),
+			N > 1 && (pgm_read_byte(&sensors[id].flags) &
+				SENSOR_AUTOINC_MSB)? reg | 0x80: reg, N, bytes);
+}
+
+uint8_t sensor_address(const uint8_t id)
+{
+	return pgm_read_byte(&sensors[id].address);
+}
+
+uint16_t sensor_scale(const uint8_t id)
+{
+	return pgm_read_word(&sensors[id].scale);
+}
+
+/* Turns samples of raw registers into x, y, z in place, d in flash */
+static void sensor_decode(const struct sensor_desc *d, int16_t v[][3],
+		const uint8_t n)
+{
+	const uint8_t hi = pgm_read_byte(&d->flags) & SENSOR_BIG_ENDIAN? 0: 1;
+	uint8_t i, a;
+
+	for (i = 0; i < n; i++) {
+		uint8_t b[6];
+
+		memcpy(b, v[i], sizeof(b));
+		for (a = 0; a < 3; a++) {
+			const uint8_t *p = &b[2 * pgm_read_byte(&d->axes[a])];
+
+			v[i][a] = p[hi] << 8 | p[!hi];
+		}
+	}
+}
+
+/* The fields are read from flash as needed, the sampler ISR has no stack
+ * to spare for a copy of the descriptor */
+uint8_t sensor_read(const uint8_t id, int16_t v[][3], const uint8_t max)
+{
+	const struct sensor_desc *d = &sensors[id];
+	const uint8_t address = pgm_read_byte(&d->address);
+	const uint8_t flags = pgm_read_byte(&d->flags);
+	uint8_t n = 1, reg, i;
+
+	if (flags & SENSOR_FIFO) {
+		uint8_t level = 0;
+
+		i2c_read_regs(address, pgm_read_byte(&d->fifo_level), 1, &level);
+		n = level & pgm_read_byte(&d->fifo_mask);
+		if (level & pgm_read_byte(&d->fifo_full)) {
+			n = pgm_read_byte(&d->fifo_size);
+			overruns[id]++;
+			PERF_INC(fifo_overruns);
+		}
+	}
+	if (n > max)
+		n = max;
+	if (!n)
+		return 0;
+
+	reg = pgm_read_byte(&d->data) | (flags & SENSOR_AUTOINC_MSB? 0x80: 0);
+	if (flags & SENSOR_FIFO_SINGLE) {
+		for (i = 0; i < n; i++)
+			if (i2c_read_regs(address, reg, sizeof(v[0]),
+						(uint8_t *)v[i]) < sizeof(v[0]))
+				break;
+		n = i;
+	} else {
+		n = i2c_read_regs(address, reg, n * sizeof(v[0]),
+				(uint8_t *)v) / sizeof(v[0]);
+	}
+	sensor_decode(d, v, n);
+	PERF_ADD(sensor_samples, n);
+
+	return n;
+}
+
+void sensor_defer(const uint8_t id, const uint32_t us)
+{
+	const uint32_t t = clock_us() + us;
+
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+		next[id] = t;
+}
+
+void sensor_set_period(const uint8_t id, const uint16_t us)
+{
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+		period[id] = us;
+}
+
+uint16_t sensor_poll(const uint16_t mask, const uint32_t now,
+		struct sensor_buf *buf)
+{
+	uint16_t got = 0;
+	uint8_t i, j;
+
+	for (i = 0; i < SENSOR_COUNT; i++) {
+		const uint8_t id = pgm_read_byte(&schedule[i]);
+		const uint16_t p = period[id]? period[id]:
+			pgm_read_word(&sensors[id].period_us);
+		const uint8_t pos = buf->head & buf->mask;
+		uint8_t max = buf->mask + 1 - pos, n;
+
+		if (!(mask & BIT(id)) || !buf->room ||
+				(int32_t)(now - next[id]) < 0)
+			continue;
+		/* Keeps the phase, unless the poller fell behind */
+		if (p)
+			next[id] = now - next[id] < p? next[id] + p: now + p;
+		if (max > buf->room)
+			max = buf->room;
+		if (max > buf->burst)
+			max = buf->burst;
+		n = sensor_read(id, &buf->v[pos], max);
+		for (j = 0; j < n; j++)
+			buf->id[pos + j] = id;
+		buf->head += n;
+		buf->room -= n;
+		if (n)
+			got |= BIT(id);
+	}
+
+	return got;
+}
+
+bool sensor_busy(const uint16_t mask)
+{
+	uint8_t id;
+
+	for (id = 0; id < SENSOR_COUNT; id++)
+		if ((mask & BIT(id)) &&
+				i2c_busy(pgm_read_byte(&sensors[id].address)))
+			return true;
+	return false;
+}
+
+uint16_t sensor_overruns(const uint8_t id)
+{
+	return overruns[id];
+}
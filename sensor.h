@@ -0,0 +1,104 @@
+#ifndef _SENSOR_H
+#define _SENSOR_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/** Descriptor driven sensor access.
+ *
+ *  Every sensor is an entry of the PROGMEM table in sensor.c: its address,
+ *  the register writes that bring it up, where its data starts and how to
+ *  get there in one burst, the byte and axis order and its scale. One
+ *  engine initialises and reads all of them and hands out x, y, z vectors
+ *  in the sensor's own LSB. Devices with a FIFO are drained in a single
+ *  burst, or a read per sample, sized by their level register.
+ *  sensor_poll() reads a set of sensors in the order of the schedule
+ *  table, skipping the ones whose next sample isn't due yet.
+ *  IDs follow the telemetry types (see telemetry.h), one less.
+ */
+
+enum SENSOR_ID {
+	SENSOR_ID_ACC,
+	SENSOR_ID_GYRO,
+	SENSOR_ID_COMPASS,
+	SENSOR_COUNT
+};
+
+enum SENSOR_FLAGS {
+	SENSOR_BIG_ENDIAN = 1 << 0,
+	/* The MSB of the register address asks for auto-increment */
+	SENSOR_AUTOINC_MSB = 1 << 1,
+	/* Reading past the last data register pops the next FIFO sample */
+	SENSOR_FIFO = 1 << 2,
+	/* A FIFO popping a sample per read instead, a burst can't span two */
+	SENSOR_FIFO_SINGLE = 1 << 3
+};
+
+struct sensor_reg {
+	uint8_t reg, value;
+};
+
+struct sensor_desc {
+	uint8_t address;
+	uint8_t flags;
+	const struct sensor_reg *init;
+	uint8_t n_init;
+	uint8_t data;          /* first data register */
+	uint8_t axes[3];       /* data register pair of x, y and z */
+	uint16_t scale;        /* micro g, deg/s or gauss per LSB */
+	uint16_t period_us;    /* default between polls, 0 for any time */
+	/* FIFO: level register, its count bits, the bit telling a full FIFO
+	 * apart from an empty one and the depth */
+	uint8_t fifo_level, fifo_mask, fifo_full, fifo_size;
+};
+
+/** Ring a poll reads into, every sample next to the ID of its sensor */
+struct sensor_buf {
+	int16_t (*v)[3];
+	uint8_t *id;
+	uint8_t mask;   /* size - 1, a power of two */
+	uint8_t head;   /* free running, moved past the samples read */
+	uint8_t room;   /* free slots from head on */
+	uint8_t burst;  /* FIFO samples per sensor at most */
+};
+
+/** Writes the init table */
+void sensor_init(const uint8_t id);
+
+void sensor_write(const uint8_t id, const uint8_t reg, const uint8_t N,
+		const uint8_t bytes[N]);
+
+uint8_t sensor_address(const uint8_t id);
+
+/** @return micro units per LSB as brought up by the init table */
+uint16_t sensor_scale(const uint8_t id);
+
+/** Reads the sample or whatever the FIFO holds, up to max, right away
+ *  @return number of samples
+ */
+uint8_t sensor_read(const uint8_t id, int16_t v[][3], const uint8_t max);
+
+/** Keeps a paced sensor from being polled for us */
+void sensor_defer(const uint8_t id, const uint32_t us);
+
+/** Changes the poll period, 0 restores the descriptor's */
+void sensor_set_period(const uint8_t id, const uint16_t us);
+
+/** Reads the sensors of the mask that are due, in schedule order. May run
+ *  in an ISR, the main loop then must not sensor_read() the same sensor.
+ *  @param now clock_us() of the poll
+ *  @param buf samples of a sensor go in oldest first, a read stops where
+ *  the ring wraps. A sensor with no room left is skipped.
+ *  @return mask of the sensors that delivered
+ */
+uint16_t sensor_poll(const uint16_t mask, const uint32_t now,
+		struct sensor_buf *buf);
+
+/** @return true if the bus of any sensor of the mask is busy, see
+ *  i2c_busy() */
+bool sensor_busy(const uint16_t mask);
+
+/** @return FIFO overruns of a sensor so far */
+uint16_t sensor_overruns(const uint8_t id);
+
+#endif /* _SENSOR_H */
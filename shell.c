@@ -0,0 +1,181 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <avr/pgmspace.h>
+
+#include "shell.h"
+#include "uart.h"
+
+#define SHELL_LINE_LENGTH 32
+
+static const struct shell_param *shell_params;
+static const struct shell_cmd *shell_cmds;
+static uint8_t shell_n_params, shell_n_cmds;
+
+static char line[SHELL_LINE_LENGTH];
+static uint8_t line_length = 0;
+
+void init_shell(const struct shell_param *params, const uint8_t n_params,
+		const struct shell_cmd *cmds, const uint8_t n_cmds)
+{
+	shell_params = params;
+	shell_n_params = n_params;
+	shell_cmds = cmds;
+	shell_n_cmds = n_cmds;
+}
+
+static void print_param(const struct shell_param *p)
+{
+	printb("%s = %u (%u..%u)\r\n", p->name, *p->value, p->min, p->max);
+}
+
+static int find_param(const char *name, struct shell_param *p)
+{
+	uint8_t i;
+
+	for (i = 0; i < shell_n_params; i++) {
+		memcpy_P(p, &shell_params[i], sizeof(*p));
+		if (!strcmp(p->name, name))
+			return 0;
+	}
+
+	printb("No such parameter: %s\r\n", name);
+	return -1;
+}
+
+static void cmd_get(char *args)
+{
+	struct shell_param p;
+	uint8_t i;
+
+	if (*args) {
+		if (!find_param(args, &p))
+			print_param(&p);
+		return;
+	}
+
+	for (i = 0; i < shell_n_params; i++) {
+		memcpy_P(&p, &shell_params[i], sizeof(p));
+		print_param(&p);
+	}
+}
+
+static void cmd_set(char *args)
+{
+	struct shell_param p;
+	char *name = strtok(args, " ");
+	char *value = strtok(NULL, " "), *end;
+	unsigned long v;
+
+	if (!name || !value) {
+		printb("Usage: set name value\r\n");
+		return;
+	}
+	if (find_param(name, &p))
+		return;
+
+	v = strtoul(value, &end, 0);
+	if (*end || v < p.min || v > p.max) {
+		printb("Out of range: %u..%u\r\n", p.min, p.max);
+		return;
+	}
+
+	*p.value = v;
+	if (p.apply)
+		p.apply(v);
+	print_param(&p);
+}
+
+static void cmd_help(char *args)
+{
+	struct shell_cmd c;
+	uint8_t i;
+
+	printb("help, get [name], set name value");
+	for (i = 0; i < shell_n_cmds; i++) {
+		memcpy_P(&c, &shell_cmds[i], sizeof(c));
+		printb(", %s", c.name);
+	}
+	printb("\r\n");
+}
+
+static void shell_run(char *s)
+{
+	char *args;
+	uint8_t i;
+
+	while (*s == ' ')
+		s++;
+	if (!*s)
+		return;
+
+	args = strchr(s, ' ');
+	if (args)
+		*args++ = '\0';
+	else
+		args = s + strlen(s);
+
+	if (!strcmp_P(s, PSTR("get"))) {
+		cmd_get(args);
+		return;
+	} else if (!strcmp_P(s, PSTR("set"))) {
+		cmd_set(args);
+		return;
+	} else if (!strcmp_P(s, PSTR("help"))) {
+		cmd_help(args);
+		return;
+	}
+
+	/* Matched in place, the command runs without a copy of its entry on
+	 * the stack */
+	for (i = 0; i < shell_n_cmds; i++) {
+		if (!strcmp_P(s, shell_cmds[i].name)) {
+			void (*run)(char *) = pgm_read_ptr(&shell_cmds[i].run);
+
+			run(args);
+			return;
+		}
+	}
+
+	printb("Unknown command: %s\r\n", s);
+}
+
+void shell_poll(void)
+{
+	enum UART_OVERFLOW_POLICY policy;
+	int c;
+
+	while ((c = uart_getc()) >= 0) {
+		switch (c) {
+			case '\r':
+			case '\n':
+				/* A reply can be longer than the TX ring, it waits
+				 * for room rather than losing the rest */
+				policy = uart_set_overflow_policy(UART_OVF_BLOCK);
+				printb("\r\n");
+				line[line_length] = '\0';
+				line_length = 0;
+				shell_run(line);
+				uart_set_overflow_policy(policy);
+				break;
+
+			case '\b':
+			case 0x7f:
+				if (line_length) {
+					line_length--;
+					printb("\b \b");
+				}
+				break;
+
+			default:
+				/* Overlong lines are cut, the rest is ignored */
+				if (line_length < sizeof(line) - 1) {
+					line[line_length++] = c;
+					uart_put(c);
+				}
+				break;
+		}
+	}
+}
@@ -0,0 +1,37 @@
+#ifndef _SHELL_H
+#define _SHELL_H
+
+#include <stdint.h>
+
+/** Line oriented command interpreter on the UART.
+ *
+ *  Built-in commands are "help", "get [name]" and "set name value", the
+ *  rest come from the command table. Both tables live in PROGMEM and are
+ *  owned by the application.
+ */
+
+#define SHELL_NAME_LENGTH 10
+
+struct shell_param {
+	char name[SHELL_NAME_LENGTH];
+	uint16_t *value;
+	uint16_t min, max;
+	/** Called after the value has been changed, may be NULL */
+	void (*apply)(const uint16_t value);
+};
+
+struct shell_cmd {
+	char name[SHELL_NAME_LENGTH];
+	/** @param args rest of the line, never NULL */
+	void (*run)(char *args);
+};
+
+void init_shell(const struct shell_param *params, const uint8_t n_params,
+		const struct shell_cmd *cmds, const uint8_t n_cmds);
+
+/** Consumes received characters and runs complete lines.
+ *  Meant to be called from the main loop.
+ */
+void shell_poll(void);
+
+#endif /* _SHELL_H */
@@ -0,0 +1,144 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "spectrum.h"
+#include "fixmath.h"
+#include "gfx.h"
+#include "perf.h"
+
+_Static_assert(GFX_WIDTH == 4 * SPECTRUM_BINS,
+		"a bar of the graph is 4 pixels wide");
+
+/* The block being collected, transformed in place once full, the
+ * magnitudes after */
+static q15_t re[FFT_SIZE];
+static uint8_t collected = 0;
+
+/* Rows of the bars */
+static uint8_t height[SPECTRUM_BINS];
+static struct spectrum_peak peaks[SPECTRUM_PEAKS];
+static uint8_t n_peaks = 0;
+static uint16_t rate = 100;
+
+void spectrum_set_rate(const uint16_t hz)
+{
+	rate = hz;
+	collected = 0;
+}
+
+/* Bin k plus the offset of the vertex of the parabola through k - 1, k and
+ * k + 1, within half a bin, in Hz */
+static uint16_t peak_hz(const uint16_t magnitude[], const uint8_t k)
+{
+	const int32_t l = magnitude[k - 1], c = magnitude[k];
+	const int32_t r = k + 1 < SPECTRUM_BINS? magnitude[k + 1]: l;
+	const int32_t den = 2 * (2 * c - l - r);
+	/* Sixteenths of a bin */
+	const int32_t bin16 = 16L * k + (den? 16 * (r - l) / den: 0);
+
+	return (bin16 * rate + 8L * FFT_SIZE) / (16L * FFT_SIZE);
+}
+
+static void find_peaks(const uint16_t magnitude[])
+{
+	uint8_t k, i;
+
+	memset(peaks, 0, sizeof(peaks));
+	n_peaks = 0;
+	for (k = 1; k < SPECTRUM_BINS; k++) {
+		const uint16_t m = magnitude[k];
+
+		if (!m || m <= magnitude[k - 1] ||
+				(k + 1 < SPECTRUM_BINS && m < magnitude[k + 1]))
+			continue;
+		/* Insertion into the list sorted by magnitude */
+		for (i = n_peaks; i > 0 && peaks[i - 1].magnitude < m; i--)
+			if (i < SPECTRUM_PEAKS)
+				peaks[i] = peaks[i - 1];
+		if (i == SPECTRUM_PEAKS)
+			continue;
+		peaks[i].hz = peak_hz(magnitude, k);
+		peaks[i].magnitude = m;
+		if (n_peaks < SPECTRUM_PEAKS)
+			n_peaks++;
+	}
+}
+
+/* 4 rows per octave, the next two bits below the MSB between */
+static uint8_t bar_height(const uint16_t m)
+{
+	uint8_t octave = 0, h;
+
+	if (!m)
+		return 0;
+	while (m >> (octave + 1))
+		octave++;
+	h = 4 * octave + (octave < 2? (m << (2 - octave)) & 3:
+			(m >> (octave - 2)) & 3) + 1;
+	return h > GFX_HEIGHT? GFX_HEIGHT: h;
+}
+
+bool spectrum_analyse(void)
+{
+	/* Written over the block, bin k over re[k] once re[2k] and re[2k + 1]
+	 * have been read */
+	uint16_t *magnitude = (uint16_t *)re;
+	int32_t sum = 0;
+	int16_t mean;
+	uint8_t i;
+
+	if (collected < FFT_SIZE)
+		return false;
+	collected = 0;
+
+	PERF_START(t_spectrum);
+	for (i = 0; i < FFT_SIZE; i++)
+		sum += re[i];
+	mean = sum / FFT_SIZE;
+	for (i = 0; i < FFT_SIZE; i++) {
+		const int16_t d = re[i] - mean;
+
+		re[i] = d > INT16_MAX >> SPECTRUM_SHIFT? INT16_MAX:
+			d < INT16_MIN >> SPECTRUM_SHIFT? INT16_MIN:
+			d * (1 << SPECTRUM_SHIFT);
+	}
+	fft_hann(re);
+	fft_real_q15(re);
+
+	/* Bin 0 is real, re[1] holds the bin at half the rate, left out */
+	magnitude[0] = fix_sqrt((int32_t)re[0] * re[0]);
+	for (i = 1; i < SPECTRUM_BINS; i++)
+		magnitude[i] = fix_sqrt((int32_t)re[2 * i] * re[2 * i] +
+				(int32_t)re[2 * i + 1] * re[2 * i + 1]);
+	find_peaks(magnitude);
+	for (i = 0; i < SPECTRUM_BINS; i++)
+		height[i] = bar_height(magnitude[i]);
+	PERF_STOP(spectrum, t_spectrum);
+	PERF_INC(spectra);
+	return true;
+}
+
+bool spectrum_push(const int16_t v)
+{
+	/* The full block waits for spectrum_analyse() */
+	if (collected == FFT_SIZE)
+		return false;
+	re[collected++] = v;
+	return collected == FFT_SIZE;
+}
+
+uint8_t spectrum_peaks(const struct spectrum_peak **p)
+{
+	*p = peaks;
+	return n_peaks;
+}
+
+void spectrum_draw(uint8_t b[])
+{
+	uint8_t k;
+
+	for (k = 0; k < SPECTRUM_BINS; k++)
+		if (height[k])
+			gfx_fill(b, 4 * k, GFX_HEIGHT - height[k], 3, height[k]);
+}
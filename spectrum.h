@@ -0,0 +1,58 @@
+#ifndef _SPECTRUM_H
+#define _SPECTRUM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "fft.h"
+
+/** Vibration spectrum of one accelerometer axis.
+ *
+ *  Samples are collected in blocks of FFT_SIZE. spectrum_analyse() takes
+ *  a full block: it loses its mean, gravity included, is shifted up by
+ *  SPECTRUM_SHIFT, Hann windowed and transformed in place (see fft.h),
+ *  then reduced to the bar heights of its SPECTRUM_BINS bins and their
+ *  largest peaks. The block needs no other SRAM, so it can be analysed
+ *  as soon as it is full, before the next sample; one pushed while a full
+ *  block waits would be dropped. The analysis takes about 2 ms on the
+ *  ATmega328P.
+ *
+ *  A sine of an amplitude of one input LSB centred on a bin reads as
+ *  SPECTRUM_LSB there.
+ */
+
+#define SPECTRUM_BINS (FFT_SIZE / 2)
+#define SPECTRUM_PEAKS 3
+
+/* 2^4 times +-2047 LSB around the mean fits Q15 */
+#define SPECTRUM_SHIFT 4
+/* The window and the negative frequencies take a half each */
+#define SPECTRUM_LSB (1 << (SPECTRUM_SHIFT - 2))
+
+struct spectrum_peak {
+	uint16_t hz;
+	uint16_t magnitude;
+};
+
+/** Sample rate of the input, drops the block in progress */
+void spectrum_set_rate(const uint16_t hz);
+
+/** @return true if v completed a block, ready for spectrum_analyse() */
+bool spectrum_push(const int16_t v);
+
+/** Analyses the full block, if any, and starts the next one
+ *  @return false if the block isn't full yet */
+bool spectrum_analyse(void);
+
+/** Local maxima of the last spectrum above the DC bin, the largest first,
+ *  their frequencies interpolated between the bins
+ *  @param p set to the SPECTRUM_PEAKS entries, zero past the ones found,
+ *  valid until the next spectrum_analyse()
+ *  @return number of peaks found */
+uint8_t spectrum_peaks(const struct spectrum_peak **p);
+
+/** Bar graph of the last spectrum, a bar of 4 pixels per bin and 4 rows
+ *  per octave of magnitude from the bottom up */
+void spectrum_draw(uint8_t b[]);
+
+#endif /* _SPECTRUM_H */
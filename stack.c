@@ -0,0 +1,47 @@
+#ifdef __AVR__
+
+#include <stdint.h>
+
+#include <avr/io.h>
+
+#include "stack.h"
+#include "uart.h"
+
+#define STACK_PAINT 0xc5
+#define STACK_STR_(x) #x
+#define STACK_STR(x) STACK_STR_(x)
+
+/* From the avr-libc linker scripts: the end of .bss and .noinit, and
+ * RAMEND */
+extern uint8_t _end;
+extern uint8_t __stack;
+
+/* After .init2 has cleared r1 and set SP, before anything is on the
+ * stack. A naked function falls through to the next init section and may
+ * only hold basic asm: Z runs from _end up to RAMEND. */
+void stack_paint(void) __attribute__((naked, used, section(".init3")));
+
+void stack_paint(void)
+{
+	__asm__ volatile (
+		"	ldi r30, lo8(_end)\n"
+		"	ldi r31, hi8(_end)\n"
+		"	ldi r24, " STACK_STR(STACK_PAINT) "\n"
+		"	ldi r25, hi8(__stack + 1)\n"
+		"1:	st Z+, r24\n"
+		"	cpi r30, lo8(__stack + 1)\n"
+		"	cpc r31, r25\n"
+		"	brne 1b\n");
+}
+
+void stack_report(void)
+{
+	const uint8_t *p = &_end;
+
+	while (p <= &__stack && *p == STACK_PAINT)
+		p++;
+	printb("stack: %u B at most, %u B never used\r\n",
+			(uint16_t)(&__stack + 1 - p), (uint16_t)(p - &_end));
+}
+
+#endif /* __AVR__ */
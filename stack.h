@@ -0,0 +1,27 @@
+#ifndef _STACK_H
+#define _STACK_H
+
+#include <stdint.h>
+
+/** Stack painting.
+ *
+ *  The SRAM between the end of .bss and RAMEND is filled with a pattern
+ *  before .data and .bss are set up. The stack grows down over it, so the
+ *  bytes still holding the pattern from the bottom up have never been
+ *  used. The deepest the stack has gone is what STACK_RESERVE in the
+ *  Makefile must cover.
+ */
+
+#ifdef __AVR__
+
+/** Prints the deepest the stack has been and what was never touched */
+void stack_report(void);
+
+#else
+
+/* The host build has no AVR stack to measure */
+static inline void stack_report(void) {}
+
+#endif /* __AVR__ */
+
+#endif /* _STACK_H */
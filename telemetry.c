@@ -0,0 +1,46 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "telemetry.h"
+#include "frame.h"
+#include "uart.h"
+
+_Static_assert(sizeof(struct telemetry_packet) <= FRAME_MAX_PAYLOAD,
+		"TELEMETRY_BATCH is too large for a frame");
+
+enum TELEMETRY_MODE telemetry_mode = TELEMETRY_TEXT;
+
+static struct telemetry_packet batch[TELEMETRY_SENSORS];
+
+static void telemetry_send(struct telemetry_packet *p)
+{
+	const uint8_t n = sizeof(p->h) + p->h.count * sizeof(p->v[0]);
+
+	frame_send(uart_put, (const uint8_t *)p, n);
+	p->h.count = 0;
+}
+
+void telemetry_sample(const enum TELEMETRY_TYPE type, const uint32_t t_us,
+		const int16_t v[3])
+{
+	struct telemetry_packet *p = &batch[type - 1];
+
+	if (!p->h.count) {
+		p->h.type = type;
+		p->h.t_first = t_us;
+	}
+	p->h.t_last = t_us;
+	memcpy(p->v[p->h.count++], v, sizeof(p->v[0]));
+
+	if (p->h.count == TELEMETRY_BATCH)
+		telemetry_send(p);
+}
+
+void telemetry_flush(void)
+{
+	uint8_t i;
+
+	for (i = 0; i < TELEMETRY_SENSORS; i++)
+		if (batch[i].h.count)
+			telemetry_send(&batch[i]);
+}
@@ -0,0 +1,65 @@
+#ifndef _TELEMETRY_H
+#define _TELEMETRY_H
+
+#include <stdint.h>
+
+/** Binary telemetry.
+ *
+ *  Raw sensor samples are batched per sensor and sent as frames (see
+ *  frame.h) over the UART ring. A packet is a telemetry_header followed by
+ *  count samples of three little-endian int16_t axes, samples in between
+ *  the first and the last one are evenly spaced.
+ *  tools/telemetry_decode turns a capture back into CSV.
+ */
+
+enum TELEMETRY_TYPE {
+	TELEMETRY_ACC = 1,
+	TELEMETRY_GYRO,
+	TELEMETRY_COMPASS,
+	TELEMETRY_SENSORS = TELEMETRY_COMPASS,
+
+	/* Other frame types sharing the link */
+	TELEMETRY_I2C_TRACE = 0x10,   /* see i2c_trace.h */
+	TELEMETRY_REPLAY_READY,       /* see replay.h */
+	TELEMETRY_REPLAY_END
+};
+
+enum TELEMETRY_MODE {
+	TELEMETRY_OFF,
+	TELEMETRY_TEXT,
+	TELEMETRY_BINARY
+};
+
+#ifndef TELEMETRY_BATCH
+#define TELEMETRY_BATCH 4
+#endif
+
+struct telemetry_header {
+	uint8_t type;
+	uint8_t count;
+	uint32_t t_first; /* us */
+	uint32_t t_last;  /* us */
+} __attribute__((packed));
+
+struct telemetry_packet {
+	struct telemetry_header h;
+	int16_t v[TELEMETRY_BATCH][3];
+} __attribute__((packed));
+
+/* TELEMETRY_REPLAY_READY is followed by the sequence number of the packet
+ * wanted, a replayed packet by its own */
+struct telemetry_replay {
+	uint8_t seq;
+	struct telemetry_packet p;
+} __attribute__((packed));
+
+extern enum TELEMETRY_MODE telemetry_mode;
+
+/** Queues a sample, the batch goes out once TELEMETRY_BATCH are collected */
+void telemetry_sample(const enum TELEMETRY_TYPE type, const uint32_t t_us,
+		const int16_t v[3]);
+
+/** Sends all partially filled batches */
+void telemetry_flush(void);
+
+#endif /* _TELEMETRY_H */
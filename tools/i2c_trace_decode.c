@@ -0,0 +1,197 @@
+/* Host side decoder of the I2C bus trace, see i2c_trace.h
+ *
+ * Usage: i2c_trace_decode [-t ticks per us] [capture file or tty]
+ * Reads stdin when no file is given, prints one line per transaction and
+ * the bus utilisation per device at the end. Other frames are skipped.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "../frame.h"
+#include "../i2c_trace.h"
+#include "../telemetry.h"
+
+struct device {
+	unsigned long transactions, bytes, errors;
+	double busy_us;
+};
+
+static struct device devices[128];
+static double ticks_per_us = 2;
+static unsigned long dropped = 0;
+
+/* Transaction being assembled */
+static struct {
+	bool open;
+	uint8_t sla;
+	uint64_t start;
+	unsigned long bytes;
+	char statuses[128];
+} tr;
+static uint64_t now = 0, first = 0, last = 0;
+
+static bool is_data(const uint8_t twsr)
+{
+	return twsr == 0x28 || twsr == 0x30 || twsr == 0x50 || twsr == 0x58;
+}
+
+/* 16-bit timestamps are taken relative to the latest full one */
+static uint64_t expand(const uint16_t ts)
+{
+	return now + (uint16_t)(ts - (uint16_t)now);
+}
+
+static void transaction_end(const uint64_t end, const uint8_t err)
+{
+	struct device *d = &devices[tr.sla >> 1];
+	const double dur = (end - tr.start) / ticks_per_us;
+
+	printf("%12.4f %10.1f  0x%02x  %c %6lu  %u  %s\n",
+			tr.start / ticks_per_us / 1000, dur, tr.sla >> 1,
+			tr.sla & 1? 'R': 'W', tr.bytes, err, tr.statuses);
+
+	d->transactions++;
+	d->bytes += tr.bytes;
+	d->errors += !!err;
+	d->busy_us += dur;
+	tr.open = false;
+	last = end;
+}
+
+static void event(const struct i2c_trace_event *e)
+{
+	char *s = tr.statuses + strlen(tr.statuses);
+	const size_t room = sizeof(tr.statuses) - (s - tr.statuses);
+
+	switch (e->status) {
+		case I2C_TRACE_EV_START:
+			if (tr.open)
+				printf("%12s transaction without STOP\n", "");
+			memset(&tr, 0, sizeof(tr));
+			tr.open = true;
+			tr.sla = e->arg;
+			now = (now & ~0xffffULL) | e->ts;
+			break;
+
+		case I2C_TRACE_EV_TIME: {
+			uint64_t t = (now & ~0xffffffffULL) |
+				(uint32_t)e->ts << 16 | (now & 0xffff);
+
+			if (t < now)
+				t += 1ULL << 32;
+			now = tr.start = t;
+			if (!first)
+				first = t;
+			break;
+		}
+
+		case I2C_TRACE_EV_STOP:
+			now = expand(e->ts);
+			if (tr.open)
+				transaction_end(now, e->arg);
+			break;
+
+		default:
+			now = expand(e->ts);
+			if (is_data(e->status))
+				tr.bytes += e->arg;
+			if (e->arg > 1)
+				snprintf(s, room, "%02x*%u ", e->status, e->arg);
+			else
+				snprintf(s, room, "%02x ", e->status);
+			break;
+	}
+}
+
+static void packet(const uint8_t *buf, const int n)
+{
+	struct i2c_trace_header h;
+	struct i2c_trace_event e;
+	int i;
+
+	if (n < (int)sizeof(h))
+		return;
+	memcpy(&h, buf, sizeof(h));
+	if (h.type != TELEMETRY_I2C_TRACE)
+		return;
+
+	if (h.dropped) {
+		printf("%12s %u events dropped\n", "", h.dropped);
+		dropped += h.dropped;
+	}
+	for (i = sizeof(h); i + (int)sizeof(e) <= n; i += sizeof(e)) {
+		memcpy(&e, buf + i, sizeof(e));
+		event(&e);
+	}
+}
+
+static void summary(void)
+{
+	const double span = (last - first) / ticks_per_us;
+	double busy = 0;
+	unsigned i;
+
+	printf("\n addr  xfers      bytes  errors    busy us   util\n");
+	for (i = 0; i < 128; i++) {
+		const struct device *d = &devices[i];
+
+		if (!d->transactions)
+			continue;
+		printf(" 0x%02x %6lu %10lu %7lu %10.0f %5.1f%%\n", i,
+				d->transactions, d->bytes, d->errors, d->busy_us,
+				span > 0? 100 * d->busy_us / span: 0);
+		busy += d->busy_us;
+	}
+	printf("bus busy %.0f us of %.0f us (%.1f%%), %lu events dropped\n",
+			busy, span, span > 0? 100 * busy / span: 0, dropped);
+}
+
+int main(int argc, char *argv[])
+{
+	struct frame_decoder d;
+	uint8_t payload[FRAME_MAX_PAYLOAD + 2];
+	uint8_t buf[256];
+	ssize_t n;
+	int fd = STDIN_FILENO;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "t:")) != -1) {
+		switch (opt) {
+			case 't':
+				ticks_per_us = strtod(optarg, NULL);
+				break;
+			default:
+				fprintf(stderr, "Usage: %s [-t ticks per us] [file]\n",
+						argv[0]);
+				return EXIT_FAILURE;
+		}
+	}
+
+	if (optind < argc) {
+		fd = open(argv[optind], O_RDONLY | O_NOCTTY);
+		if (fd < 0) {
+			perror(argv[optind]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	frame_decoder_init(&d, payload, sizeof(payload));
+	printf("%12s %10s  addr dir bytes err statuses\n", "start ms", "dur us");
+	while ((n = read(fd, buf, sizeof(buf))) > 0) {
+		ssize_t i;
+
+		for (i = 0; i < n; i++) {
+			const int len = frame_decode(&d, buf[i]);
+
+			if (len > 0)
+				packet(d.buf, len);
+		}
+	}
+
+	summary();
+	return EXIT_SUCCESS;
+}
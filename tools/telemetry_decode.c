@@ -0,0 +1,160 @@
+/* Host side decoder of the binary telemetry, see telemetry.h
+ *
+ * Usage: telemetry_decode [-b baudrate] [-w raw file] [capture file or tty]
+ * Reads stdin when no file is given and writes CSV to stdout. The raw input
+ * can be saved with -w for tools/telemetry_replay.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <termios.h>
+
+#include "../frame.h"
+#include "../telemetry.h"
+
+static const char *sensor_names[] = {
+	[TELEMETRY_ACC]     = "acc",
+	[TELEMETRY_GYRO]    = "gyro",
+	[TELEMETRY_COMPASS] = "compass",
+};
+
+static speed_t to_speed(const long baudrate)
+{
+	switch (baudrate) {
+		case 9600:    return B9600;
+		case 57600:   return B57600;
+		case 115200:  return B115200;
+		case 230400:  return B230400;
+		case 500000:  return B500000;
+		case 1000000: return B1000000;
+		case 2000000: return B2000000;
+		default:      return B0;
+	}
+}
+
+static int setup_tty(const int fd, const long baudrate)
+{
+	struct termios t;
+
+	if (tcgetattr(fd, &t))
+		return -1;
+	cfmakeraw(&t);
+	if (cfsetspeed(&t, to_speed(baudrate)))
+		return -1;
+	return tcsetattr(fd, TCSANOW, &t);
+}
+
+/* Timestamps are 32-bit microseconds, unwrap them per sensor */
+static uint64_t unwrap(const uint8_t type, const uint32_t t)
+{
+	static uint64_t last[TELEMETRY_SENSORS + 1];
+	uint64_t u = (last[type] & ~0xffffffffULL) | t;
+
+	if (u < last[type])
+		u += 1ULL << 32;
+	last[type] = u;
+
+	return u;
+}
+
+static void dump_packet(const uint8_t *buf, const int n)
+{
+	struct telemetry_header h;
+	uint64_t t0, t1;
+	int i;
+
+	if (n < (int)sizeof(h))
+		return;
+	memcpy(&h, buf, sizeof(h));
+	if (!h.type || h.type > TELEMETRY_SENSORS || !h.count ||
+			n != (int)(sizeof(h) + h.count * 3 * sizeof(int16_t)))
+		return;
+
+	t0 = unwrap(h.type, h.t_first);
+	t1 = unwrap(h.type, h.t_last);
+	for (i = 0; i < h.count; i++) {
+		const uint8_t *p = buf + sizeof(h) + i * 3 * sizeof(int16_t);
+		const uint64_t t = h.count > 1?
+			t0 + (t1 - t0) * i / (h.count - 1): t0;
+
+		printf("%s,%llu,%d,%d,%d\n", sensor_names[h.type],
+				(unsigned long long)t,
+				(int16_t)(p[0] | p[1] << 8),
+				(int16_t)(p[2] | p[3] << 8),
+				(int16_t)(p[4] | p[5] << 8));
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	struct frame_decoder d;
+	uint8_t payload[FRAME_MAX_PAYLOAD + 2];
+	unsigned long good = 0, bad = 0;
+	long baudrate = 115200;
+	uint8_t buf[256];
+	ssize_t n;
+	int fd = STDIN_FILENO;
+	FILE *raw = NULL;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "b:w:")) != -1) {
+		switch (opt) {
+			case 'b':
+				baudrate = strtol(optarg, NULL, 0);
+				break;
+			case 'w':
+				raw = fopen(optarg, "wb");
+				if (!raw) {
+					perror(optarg);
+					return EXIT_FAILURE;
+				}
+				break;
+			default:
+				fprintf(stderr, "Usage: %s [-b baudrate] [-w raw file] "
+						"[file]\n", argv[0]);
+				return EXIT_FAILURE;
+		}
+	}
+
+	if (optind < argc) {
+		fd = open(argv[optind], O_RDONLY | O_NOCTTY);
+		if (fd < 0) {
+			perror(argv[optind]);
+			return EXIT_FAILURE;
+		}
+	}
+	if (isatty(fd) && setup_tty(fd, baudrate)) {
+		perror("tty setup");
+		return EXIT_FAILURE;
+	}
+
+	frame_decoder_init(&d, payload, sizeof(payload));
+	printf("sensor,t_us,x,y,z\n");
+	while ((n = read(fd, buf, sizeof(buf))) > 0) {
+		ssize_t i;
+
+		if (raw && fwrite(buf, 1, n, raw) != (size_t)n) {
+			perror("raw capture");
+			return EXIT_FAILURE;
+		}
+		for (i = 0; i < n; i++) {
+			const int len = frame_decode(&d, buf[i]);
+
+			if (len > 0) {
+				dump_packet(d.buf, len);
+				good++;
+			} else if (len < 0) {
+				bad++;
+			}
+		}
+		fflush(stdout);
+	}
+	if (raw)
+		fclose(raw);
+
+	fprintf(stderr, "%lu frames decoded, %lu dropped\n", good, bad);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,264 @@
+/* Streams a binary telemetry capture back to the firmware, see replay.h
+ *
+ * Usage: telemetry_replay [-b baudrate] capture device
+ * The capture is the raw UART output of a "set telemetry 2" run, as saved
+ * by telemetry_decode -w. The device is the board's tty or the pty of
+ * main-host run with SIM_PTY=1.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <termios.h>
+#include <time.h>
+#include <sys/select.h>
+
+#include "../frame.h"
+#include "../telemetry.h"
+
+/* Resend a packet when the device asked for nothing for that long */
+#define REPLAY_TIMEOUT_MS 1000
+
+struct capture {
+	struct telemetry_packet *p;
+	size_t n, size;
+};
+
+static uint8_t out[2 * FRAME_MAX_PAYLOAD];
+static size_t out_len;
+
+static speed_t to_speed(const long baudrate)
+{
+	switch (baudrate) {
+		case 9600:    return B9600;
+		case 57600:   return B57600;
+		case 115200:  return B115200;
+		case 230400:  return B230400;
+		case 500000:  return B500000;
+		case 1000000: return B1000000;
+		case 2000000: return B2000000;
+		default:      return B0;
+	}
+}
+
+static int setup_tty(const int fd, const long baudrate)
+{
+	struct termios t;
+
+	if (tcgetattr(fd, &t))
+		return -1;
+	cfmakeraw(&t);
+	if (cfsetspeed(&t, to_speed(baudrate)))
+		return -1;
+	return tcsetattr(fd, TCSANOW, &t);
+}
+
+static void capture_add(struct capture *c, const uint8_t *buf, const int n)
+{
+	struct telemetry_header h;
+
+	if (n < (int)sizeof(h))
+		return;
+	memcpy(&h, buf, sizeof(h));
+	if (!h.type || h.type > TELEMETRY_SENSORS || !h.count ||
+			n != (int)(sizeof(h) + h.count * 3 * sizeof(int16_t)))
+		return;
+	if (h.count > TELEMETRY_BATCH) {
+		fprintf(stderr, "skipping a batch of %u samples\n", h.count);
+		return;
+	}
+
+	if (c->n == c->size) {
+		c->size = c->size? 2 * c->size: 1024;
+		c->p = realloc(c->p, c->size * sizeof(*c->p));
+		if (!c->p) {
+			perror("realloc");
+			exit(EXIT_FAILURE);
+		}
+	}
+	memcpy(&c->p[c->n++], buf, n);
+}
+
+static int capture_load(struct capture *c, const char *path)
+{
+	struct frame_decoder d;
+	uint8_t payload[FRAME_MAX_PAYLOAD + 2];
+	uint8_t buf[256];
+	ssize_t n;
+	int fd = open(path, O_RDONLY);
+
+	if (fd < 0)
+		return -1;
+	frame_decoder_init(&d, payload, sizeof(payload));
+	while ((n = read(fd, buf, sizeof(buf))) > 0) {
+		ssize_t i;
+
+		for (i = 0; i < n; i++) {
+			const int len = frame_decode(&d, buf[i]);
+
+			if (len > 0)
+				capture_add(c, d.buf, len);
+		}
+	}
+	close(fd);
+
+	return 0;
+}
+
+static void put(const uint8_t c)
+{
+	out[out_len++] = c;
+}
+
+static int send_frame(const int fd, const uint8_t *payload, const uint8_t n)
+{
+	out_len = 0;
+	frame_send(put, payload, n);
+	return write(fd, out, out_len) == (ssize_t)out_len? 0: -1;
+}
+
+/* Numbered as the device counts them, see struct telemetry_replay */
+static int send_packet(const int fd, const struct telemetry_packet *p,
+		const size_t seq)
+{
+	struct telemetry_replay r;
+
+	r.seq = seq;
+	memcpy(&r.p, p, sizeof(r.p));
+	return send_frame(fd, (const uint8_t *)&r, sizeof(r.seq) +
+			sizeof(p->h) + p->h.count * sizeof(p->v[0]));
+}
+
+static double now_s(void)
+{
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+int main(int argc, char *argv[])
+{
+	const uint8_t end = TELEMETRY_REPLAY_END;
+	struct capture c = { 0 };
+	struct frame_decoder d;
+	uint8_t payload[FRAME_MAX_PAYLOAD + 2];
+	long baudrate = 115200;
+	size_t acked = 0, resent = 0, i;
+	bool sent = false;  /* c.p[acked] has gone out */
+	uint64_t t_first = 0, t_last = 0;
+	double t0;
+	int fd, opt;
+
+	while ((opt = getopt(argc, argv, "b:")) != -1) {
+		switch (opt) {
+			case 'b':
+				baudrate = strtol(optarg, NULL, 0);
+				break;
+			default:
+				goto usage;
+		}
+	}
+	if (optind + 2 != argc)
+		goto usage;
+
+	if (capture_load(&c, argv[optind])) {
+		perror(argv[optind]);
+		return EXIT_FAILURE;
+	}
+	if (!c.n) {
+		fprintf(stderr, "%s: no sensor samples\n", argv[optind]);
+		return EXIT_FAILURE;
+	}
+
+	fd = open(argv[optind + 1], O_RDWR | O_NOCTTY);
+	if (fd < 0) {
+		perror(argv[optind + 1]);
+		return EXIT_FAILURE;
+	}
+	if (isatty(fd) && setup_tty(fd, baudrate)) {
+		perror("tty setup");
+		return EXIT_FAILURE;
+	}
+
+	frame_decoder_init(&d, payload, sizeof(payload));
+	if (write(fd, "replay\r", 7) != 7)
+		goto io_error;
+
+	t0 = now_s();
+	while (acked < c.n) {
+		struct timeval timeout = { 0, REPLAY_TIMEOUT_MS * 1000 };
+		uint8_t buf[256];
+		fd_set fds;
+		ssize_t n;
+
+		FD_ZERO(&fds);
+		FD_SET(fd, &fds);
+		if (select(fd + 1, &fds, NULL, NULL, &timeout) < 0)
+			goto io_error;
+		if (!FD_ISSET(fd, &fds)) {
+			/* The request or the packet got lost on the way, a packet
+			 * the device has already got is dropped there */
+			if (sent? send_packet(fd, &c.p[acked], acked):
+					write(fd, "replay\r", 7) != 7)
+				goto io_error;
+			resent++;
+			continue;
+		}
+
+		n = read(fd, buf, sizeof(buf));
+		if (n <= 0)
+			goto io_error;
+		for (i = 0; i < (size_t)n && acked < c.n; i++) {
+			const int len = frame_decode(&d, buf[i]);
+
+			if (len != 2 || d.buf[0] != TELEMETRY_REPLAY_READY)
+				continue;
+			/* Asking for the next one: the last one arrived. Asking
+			 * for the same one again: it was corrupt. */
+			if (sent && d.buf[1] == (uint8_t)(acked + 1)) {
+				acked++;
+				sent = false;
+				if (!(acked % 256))
+					fprintf(stderr, "\r%zu/%zu packets", acked, c.n);
+			} else if (d.buf[1] != (uint8_t)acked) {
+				continue;
+			}
+			if (acked == c.n)
+				break;
+			if (sent)
+				resent++;
+			if (send_packet(fd, &c.p[acked], acked))
+				goto io_error;
+			sent = true;
+		}
+	}
+	if (send_frame(fd, &end, sizeof(end)))
+		goto io_error;
+
+	/* Recorded span, ignoring the 32-bit wrap of a single capture */
+	for (i = 0; i < c.n; i++) {
+		const uint64_t t = c.p[i].h.t_last;
+
+		if (!t_first || c.p[i].h.t_first < t_first)
+			t_first = c.p[i].h.t_first;
+		if (t > t_last)
+			t_last = t;
+	}
+	fprintf(stderr, "\r%zu packets, %zu resent, %.3f s recorded "
+			"replayed in %.3f s\n", c.n, resent, (t_last - t_first) / 1e6,
+			now_s() - t0);
+
+	return EXIT_SUCCESS;
+
+io_error:
+	perror(argv[optind + 1]);
+	return EXIT_FAILURE;
+
+usage:
+	fprintf(stderr, "Usage: %s [-b baudrate] capture device\n", argv[0]);
+	return EXIT_FAILURE;
+}
@@ -1,26 +1,118 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <stdbool.h>
 #include <string.h>
+#include <stdarg.h>
 
 #include <avr/io.h>
 #include <avr/interrupt.h>
+#include <util/atomic.h>
 
 #include "uart.h"
+#include "perf.h"
 
 #define BIT(n) (1 << n)
 
-static char print_buffer[128];
-static uint8_t print_start = 0, print_end = 0;
+/* Indices are free-running and only masked on access, so head - tail is the
+ * fill level and no slot is wasted to tell full from empty. That needs the
+ * size to be a power of two no larger than half of the index range. */
+#define TX_BUF_SIZE 128
+#define TX_BUF_MASK (TX_BUF_SIZE - 1)
+_Static_assert(!(TX_BUF_SIZE & TX_BUF_MASK) && TX_BUF_SIZE <= 128,
+		"TX_BUF_SIZE must be a power of two up to 128");
 
-void init_uart(const unsigned long baudrate)
+static char tx_buffer[TX_BUF_SIZE];
+/* tx_head is written by the producer only, tx_tail by the UDRE ISR only
+ * (except for UART_OVF_OVERWRITE_OLDEST, which does it with interrupts off) */
+static volatile uint8_t tx_head = 0, tx_tail = 0;
+static uint16_t tx_dropped = 0;
+static enum UART_OVERFLOW_POLICY tx_policy = UART_OVF_DROP_NEWEST;
+
+/* RX ring, written by the RX ISR, read by uart_getc */
+#define RX_BUF_SIZE UART_RX_SIZE
+#define RX_BUF_MASK (RX_BUF_SIZE - 1)
+_Static_assert(!(RX_BUF_SIZE & RX_BUF_MASK) && RX_BUF_SIZE <= 128,
+		"RX_BUF_SIZE must be a power of two up to 128");
+
+static uint8_t rx_buffer[RX_BUF_SIZE];
+static volatile uint8_t rx_head = 0, rx_tail = 0;
+static volatile uint16_t rx_dropped = 0;
+
+static int uart_putchar(char c, FILE *stream);
+#ifdef __AVR__
+static FILE uart_file = FDEV_SETUP_STREAM(uart_putchar, NULL, _FDEV_SETUP_WRITE);
+#endif
+FILE *uart_out = NULL;
+
+/* Largest tolerated baud rate error, in 0.1%. 8N1 frames are received
+ * reliably up to about +-2.5% of total error between both ends. */
+#define UART_MAX_BAUD_ERROR 25
+
+struct uart_baud {
+	uint16_t ubrr;
+	bool u2x;
+	int16_t error; /* 0.1% */
+};
+
+static int16_t uart_error = 0;
+
+static bool uart_baud_calc(const unsigned long baudrate, const bool u2x,
+		struct uart_baud *b)
 {
-	const uint16_t ubrr = F_CPU / 8 / baudrate - 1;
+	const uint32_t divisor = (u2x? 8UL: 16UL) * baudrate;
+	const uint32_t n = (F_CPU + divisor / 2) / divisor;
+	int32_t actual;
+
+	if (!n || n > 4096)
+		return false;
+
+	actual = F_CPU / (divisor / baudrate * n);
+	b->ubrr = n - 1;
+	b->u2x = u2x;
+	b->error = (actual - (int32_t)baudrate) * 1000 / (int32_t)baudrate;
 
-	UBRR0H = ubrr >> 8;
-	UBRR0L = ubrr & 0xff;
-	UCSR0A |= BIT(U2X0);
-	UCSR0B = BIT(UDRIE0) | BIT(TXEN0);
+	return true;
+}
+
+int init_uart(const unsigned long baudrate)
+{
+	struct uart_baud normal, fast, *b = NULL;
+
+	if (uart_baud_calc(baudrate, false, &normal))
+		b = &normal;
+	/* Double speed halves the receiver sampling, so it has to be
+	 * strictly better to be picked */
+	if (uart_baud_calc(baudrate, true, &fast) &&
+			(!b || abs(fast.error) < abs(b->error)))
+		b = &fast;
+
+	if (!b || abs(b->error) > UART_MAX_BAUD_ERROR)
+		return -1;
+
+	UBRR0H = b->ubrr >> 8;
+	UBRR0L = b->ubrr & 0xff;
+	if (b->u2x)
+		UCSR0A |= BIT(U2X0);
+	else
+		UCSR0A &= ~BIT(U2X0);
+	UCSR0B = BIT(TXEN0) | BIT(RXEN0) | BIT(RXCIE0);
 	UCSR0C = 3 << UCSZ00;
+	uart_error = b->error;
+
+#ifdef __AVR__
+	uart_out = &uart_file;
+#else
+	/* Streams can't be set up statically outside avr-libc */
+	if (!uart_out)
+		uart_out = fdevopen(uart_putchar, NULL);
+#endif
+	stdout = uart_out;
+	return 0;
+}
+
+int16_t uart_baud_error(void)
+{
+	return uart_error;
 }
 
 int print_polling(const char str[])
@@ -44,56 +136,154 @@ int print_polling(const char str[])
 	return N;
 }
 
-static inline void update_udr()
+enum UART_OVERFLOW_POLICY uart_set_overflow_policy(
+		const enum UART_OVERFLOW_POLICY policy)
 {
-	if (print_start == print_end)
-		return;
+	const enum UART_OVERFLOW_POLICY old = tx_policy;
 
-	UDR0 = print_buffer[print_start];
-	print_start = (print_start + 1) % sizeof(print_buffer);
+	tx_policy = policy;
+	return old;
 }
 
-void printb(const char fmt[], ...)
+uint16_t uart_dropped(void)
 {
-	const typeof(print_start) BUF_SIZE = sizeof(print_buffer);
-	const typeof(print_start) AVAILABLE_TO_OVF =
-		BUF_SIZE - print_end;
-	const typeof(print_start) AVAILABLE_BUF_SPACE =
-		(AVAILABLE_TO_OVF + print_start - 1) % BUF_SIZE;
-	int n;
+	uint16_t n;
 
-	char str[MAX_BUFFERABLE_STR_LENGTH];
-	va_list args;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+		n = tx_dropped;
 
-	va_start(args, fmt);
-	n = vsnprintf(str, sizeof(str), fmt, args);
-	if (n > sizeof(str))
-		n = sizeof(str);
-	va_end(args);
+	return n;
+}
+
+uint8_t uart_tx_free(void)
+{
+	return TX_BUF_SIZE - (uint8_t)(tx_head - tx_tail);
+}
+
+int uart_getc(void)
+{
+	const uint8_t tail = rx_tail;
+	uint8_t c;
+
+	if (tail == rx_head)
+		return -1;
+
+	c = rx_buffer[tail & RX_BUF_MASK];
+	rx_tail = tail + 1;
+	return c;
+}
+
+uint16_t uart_rx_dropped(void)
+{
+	uint16_t n;
 
-	if (n > AVAILABLE_BUF_SPACE) {
-		if (AVAILABLE_BUF_SPACE == 0)
-			return;
-		n = AVAILABLE_BUF_SPACE-1;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+		n = rx_dropped;
+
+	return n;
+}
+
+static inline bool tx_full(const uint8_t head)
+{
+	return (uint8_t)(head - tx_tail) == TX_BUF_SIZE;
+}
+
+static bool tx_put(const char c)
+{
+	const uint8_t head = tx_head;
+
+	if (tx_full(head)) {
+		switch (tx_policy) {
+			case UART_OVF_BLOCK:
+				/* Nobody would drain the ring with interrupts off */
+				if (SREG & BIT(SREG_I)) {
+					UCSR0B |= BIT(UDRIE0);
+					/* UCSR0A only for the host sim, where time
+					 * passes on register accesses */
+					while (tx_full(head))
+						(void)UCSR0A;
+					break;
+				}
+				/* fall through */
+			case UART_OVF_DROP_NEWEST:
+				tx_dropped++;
+				return false;
+
+			case UART_OVF_OVERWRITE_OLDEST:
+				ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+					if (tx_full(head)) {
+						tx_tail++;
+						tx_dropped++;
+					}
+				}
+				break;
+		}
 	}
 
-	if (n < AVAILABLE_TO_OVF) {
-		memcpy(print_buffer + print_end, str, n);
-		print_end += n;
-	} else {
-		memcpy(print_buffer + print_end, str, AVAILABLE_TO_OVF);
-		memcpy(print_buffer, str + AVAILABLE_TO_OVF, n - AVAILABLE_TO_OVF);
-		print_end = n - AVAILABLE_TO_OVF;
+	tx_buffer[head & TX_BUF_MASK] = c;
+	tx_head = head + 1;
+	return true;
+}
+
+void uart_put(const uint8_t c)
+{
+	PERF_INC(uart_queued);
+	/* Idle transmitter, no need to go through the ring and the ISR. The
+	 * ISR can't be draining anything as the ring is empty. */
+	if (tx_head == tx_tail && (UCSR0A & BIT(UDRE0))) {
+		UDR0 = c;
+		return;
 	}
 
-	cli();
-	if (UCSR0A & (1 << UDRE0))
-		update_udr();
-	sei();
+	tx_put(c);
+	/* Let the ISR pick up whatever has been queued */
+	UCSR0B |= BIT(UDRIE0);
+}
+
+static int uart_putchar(char c, FILE *stream)
+{
+	uart_put(c);
+	return 0;
+}
+
+void printb_P(const char fmt[], ...)
+{
+	va_list args;
+
+	va_start(args, fmt);
+	vfprintf_P(uart_out, fmt, args);
+	va_end(args);
 }
 
 ISR(USART_UDRE_vect)
 {
-	update_udr();
+	const uint8_t head = tx_head;
+	uint8_t tail = tx_tail;
+
+	/* UDR0 and the shift register make a two byte FIFO, fill both when
+	 * possible to save an interrupt entry per byte at high baud rates */
+	do {
+		if (tail == head) {
+			UCSR0B &= ~BIT(UDRIE0);
+			break;
+		}
+		UDR0 = tx_buffer[tail++ & TX_BUF_MASK];
+	} while (UCSR0A & BIT(UDRE0));
+
+	tx_tail = tail;
 }
 
+ISR(USART_RX_vect)
+{
+	const uint8_t head = rx_head;
+	/* Reading UDR0 clears the interrupt, so do it even when full */
+	const uint8_t c = UDR0;
+
+	if ((uint8_t)(head - rx_tail) == RX_BUF_SIZE) {
+		rx_dropped++;
+		return;
+	}
+
+	rx_buffer[head & RX_BUF_MASK] = c;
+	rx_head = head + 1;
+}
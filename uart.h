@@ -1,15 +1,46 @@
 #ifndef _UART_H
 #define _UART_H
 
+#include <stdio.h>
+#include <stdint.h>
+#include <inttypes.h>
+
 #include <avr/io.h>
 #include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+
+/** What printb does when the TX ring has no room for the next byte */
+enum UART_OVERFLOW_POLICY {
+	UART_OVF_BLOCK,            /**< wait for the ISR to free space */
+	UART_OVF_DROP_NEWEST,      /**< discard the byte being queued */
+	UART_OVF_OVERWRITE_OLDEST  /**< discard the oldest queued byte */
+};
 
-#define MAX_BUFFERABLE_STR_LENGTH 64
+/** Conversion of a PROGMEM string argument, "%" PRIpgm like the PRI macros
+ *  of <inttypes.h>: %S on the AVR, %s where PSTR() is a plain string
+ */
+#ifdef __AVR__
+#define PRIpgm "S"
+#else
+#define PRIpgm "s"
+#endif
+
+/** Write-only stream feeding the TX ring, stdout points to it after init */
+extern FILE *uart_out;
 
 /** UART Initialization function
- *  Enables UART interrupt and powers up the UART module
+ *  Powers up the UART module with interrupt driven RX, the TX interrupt is
+ *  enabled on demand.
+ *
+ *  Picks normal or double speed mode and the closest UBRR for the rate,
+ *  500k, 1M and 2M baud are exact at 16 MHz.
+ *  @return 0, or -1 if the rate can't be met within the error margin, in
+ *  which case the UART is left untouched
  */
-void init_uart(const unsigned long baudrate);
+int init_uart(const unsigned long baudrate);
+
+/** @return deviation of the actual baud rate from the requested, in 0.1% */
+int16_t uart_baud_error(void);
 
 /** Primitive synchronous printing.
  *
@@ -20,6 +51,45 @@ void init_uart(const unsigned long baudrate);
  */
 int print_polling(const char str[]);
 
-void printb(const char fmt[], ...);
+/** Buffered printing, the ring is drained by the UDRE interrupt.
+ *
+ *  Formats straight into the ring through uart_out, so there is neither an
+ *  intermediate buffer nor a length limit.
+ *
+ *  The ring is single-producer: printb must not be called from an ISR
+ *  while the main loop may be printing as well.
+ *
+ *  The format stays in flash, printb() takes a literal, printb_P() a
+ *  PSTR() or a PROGMEM string.
+ */
+void printb_P(const char fmt[], ...) __attribute__((format(printf, 1, 2)));
+#define printb(fmt, ...) printb_P(PSTR(fmt), ##__VA_ARGS__)
+
+/** Queues a single raw byte, e.g. of a binary frame */
+void uart_put(const uint8_t c);
+
+/* Bytes the RX ring holds until uart_getc() */
+#define UART_RX_SIZE 64
+
+/** Non-blocking read from the RX ring
+ *  @return received byte or -1 if there is none
+ */
+int uart_getc(void);
+
+/** @return number of received bytes lost to a full RX ring */
+uint16_t uart_rx_dropped(void);
+
+/** Selects the overflow policy, UART_OVF_DROP_NEWEST by default.
+ *  UART_OVF_BLOCK degrades to dropping when called with interrupts off.
+ *  @return the previous policy
+ */
+enum UART_OVERFLOW_POLICY uart_set_overflow_policy(
+		const enum UART_OVERFLOW_POLICY policy);
+
+/** @return number of bytes that can be queued without overflowing */
+uint8_t uart_tx_free(void);
+
+/** @return number of bytes lost to overflow since init_uart */
+uint16_t uart_dropped(void);
 
 #endif /* _UART_H */
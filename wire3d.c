@@ -0,0 +1,109 @@
+#include <stdint.h>
+
+#include <avr/pgmspace.h>
+
+#include "wire3d.h"
+#include "gfx.h"
+
+/* Camera behind the model and above it, in model units */
+#define WIRE3D_DISTANCE 64
+#define WIRE3D_ELEVATION DEG_TO_ANGLE(20)
+/* Pixels per model unit at a depth of one unit */
+#define WIRE3D_FOCAL 56
+/* Model units are scaled up by this shift before the rotation, so that
+ * its rounding stays well below a pixel */
+#define WIRE3D_SHIFT 4
+
+static const int8_t cube_vertices[][3] PROGMEM = {
+	{  16,  16,  16 }, {  16, -16,  16 }, {  16, -16, -16 }, {  16,  16, -16 },
+	{ -16,  16,  16 }, { -16, -16,  16 }, { -16, -16, -16 }, { -16,  16, -16 },
+};
+
+static const uint8_t cube_edges[][2] PROGMEM = {
+	{ 0, 1 }, { 1, 2 }, { 2, 3 }, { 3, 0 },
+	{ 4, 5 }, { 5, 6 }, { 6, 7 }, { 7, 4 },
+	{ 0, 4 }, { 1, 5 }, { 2, 6 }, { 3, 7 },
+};
+
+const struct wire3d_model wire3d_cube PROGMEM = {
+	cube_vertices, cube_edges,
+	sizeof(cube_vertices) / sizeof(cube_vertices[0]),
+	sizeof(cube_edges) / sizeof(cube_edges[0]),
+};
+
+/* Fuselage, swept wing, tailplane and fin */
+static const int8_t aircraft_vertices[][3] PROGMEM = {
+	{  24,   0,  0 }, /* nose */
+	{ -16,   0,  0 }, /* tail */
+	{   6,   0,  0 }, /* wing root, leading edge */
+	{  -4,  22,  0 }, /* left wing tip */
+	{  -4, -22,  0 }, /* right wing tip */
+	{  -6,   0,  0 }, /* wing root, trailing edge */
+	{ -14,   8,  0 },
+	{ -14,  -8,  0 },
+	{ -11,   0,  0 }, /* tailplane and fin root */
+	{ -18,   0, 10 }, /* fin top */
+};
+
+static const uint8_t aircraft_edges[][2] PROGMEM = {
+	{ 0, 1 },
+	{ 2, 3 }, { 3, 5 }, { 2, 4 }, { 4, 5 },
+	{ 8, 6 }, { 6, 1 }, { 8, 7 }, { 7, 1 },
+	{ 8, 9 }, { 9, 1 },
+};
+
+_Static_assert(sizeof(cube_vertices) / sizeof(cube_vertices[0]) <=
+		WIRE3D_MAX_VERTICES, "cube too large");
+_Static_assert(sizeof(aircraft_vertices) / sizeof(aircraft_vertices[0]) <=
+		WIRE3D_MAX_VERTICES, "aircraft too large");
+
+const struct wire3d_model wire3d_aircraft PROGMEM = {
+	aircraft_vertices, aircraft_edges,
+	sizeof(aircraft_vertices) / sizeof(aircraft_vertices[0]),
+	sizeof(aircraft_edges) / sizeof(aircraft_edges[0]),
+};
+
+/* World y goes to the left of the screen. The camera looks down x, tilted
+ * by the elevation: s and c are its Q1.14 sine and cosine. */
+static void project(const int16_t w[3], int16_t p[2], const q14_t s,
+		const q14_t c)
+{
+	const int16_t depth = (WIRE3D_DISTANCE << WIRE3D_SHIFT) +
+		(((int32_t)w[0] * c - (int32_t)w[2] * s) >> 14);
+	const int16_t up = ((int32_t)w[0] * s + (int32_t)w[2] * c) >> 14;
+
+	p[0] = GFX_WIDTH / 2 - (int32_t)w[1] * WIRE3D_FOCAL / depth;
+	p[1] = GFX_HEIGHT / 2 - (int32_t)up * WIRE3D_FOCAL / depth;
+}
+
+void wire3d_draw(uint8_t b[], const struct wire3d_model *model,
+		const struct fix_mat3 *r)
+{
+	const q14_t s = fix_sin(WIRE3D_ELEVATION) >> 1;
+	const q14_t c = fix_cos(WIRE3D_ELEVATION) >> 1;
+	struct wire3d_model m;
+	int16_t p[WIRE3D_MAX_VERTICES][2];
+	uint8_t i;
+
+	memcpy_P(&m, model, sizeof(m));
+	if (m.n_vertices > WIRE3D_MAX_VERTICES)
+		return;
+
+	for (i = 0; i < m.n_vertices; i++) {
+		int16_t v[3], w[3];
+		uint8_t a;
+
+		for (a = 0; a < 3; a++)
+			v[a] = (int8_t)pgm_read_byte(&m.vertices[i][a]) <<
+				WIRE3D_SHIFT;
+		fix_mat3_apply(r, v, w);
+		project(w, p[i], s, c);
+	}
+
+	for (i = 0; i < m.n_edges; i++) {
+		const int16_t *p0 = p[pgm_read_byte(&m.edges[i][0])];
+		const int16_t *p1 = p[pgm_read_byte(&m.edges[i][1])];
+
+		line(b, p0[0], p0[1], p1[0], p1[1]);
+	}
+}
@@ -0,0 +1,37 @@
+#ifndef _WIRE3D_H
+#define _WIRE3D_H
+
+#include <stdint.h>
+
+#include "fixmath.h"
+
+/** Wireframe models on the framebuffer, in fixed point only.
+ *
+ *  A model is PROGMEM tables of vertices in the accelerometer frame of
+ *  fusion.h, taken as x forward, y left and z up, and of the edges between
+ *  them. wire3d_draw() rotates every vertex once (see fix_rotation()),
+ *  projects it in perspective with the board seen from behind and above,
+ *  then draws the edges with line(). The cube takes 8 rotations, 16
+ *  divisions and 12 lines.
+ */
+
+/* The projected vertices are kept on the stack of the caller */
+#define WIRE3D_MAX_VERTICES 10
+
+struct wire3d_model {
+	const int8_t (*vertices)[3];
+	const uint8_t (*edges)[2];
+	uint8_t n_vertices;
+	uint8_t n_edges;
+};
+
+/* Both in PROGMEM, the vertices within 32 units of the origin */
+extern const struct wire3d_model wire3d_cube;
+extern const struct wire3d_model wire3d_aircraft;
+
+/** @param m model in PROGMEM
+ *  @param r body to world rotation */
+void wire3d_draw(uint8_t b[], const struct wire3d_model *m,
+		const struct fix_mat3 *r);
+
+#endif /* _WIRE3D_H */